@@ -0,0 +1,295 @@
+#include "attributecolumns.h"
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+using namespace cl;
+
+double Dataset::AttributeColumns::Column::number(int record) const
+{
+    switch (type)
+    {
+    case ColumnType::Integer:
+        return double(integers[record]);
+
+    case ColumnType::Double:
+        return doubles[record];
+
+    case ColumnType::Bool:
+        return isTrue(record) ? 1.0 : 0.0;
+
+    default:
+        return 0.0;
+    }
+}
+
+std::size_t Dataset::AttributeColumns::Column::memoryUsage() const
+{
+    std::size_t usage = integers.capacity() * sizeof(long long) + doubles.capacity() * sizeof(double)
+            + codes.capacity() * sizeof(int) + dictionary.capacity() * sizeof(std::string)
+            + (trueBits.capacity() + nullBits.capacity()) * sizeof(std::uint64_t);
+
+    for (auto const& value : dictionary)
+        usage += value.capacity();
+
+    return usage;
+}
+
+Dataset::AttributeColumns::AttributeColumns(std::string const& shpPath)
+    : _path(shpPath), _dbfHandle(nullptr), _recordCount(0)
+{
+    // DBFOpen() swaps the extension for .dbf itself.
+    _dbfHandle = DBFOpen(shpPath.c_str(), "rbm");
+    if (_dbfHandle == nullptr)
+        return;
+
+    _recordCount = DBFGetRecordCount(_dbfHandle);
+
+    for (int fieldIndex = 0; fieldIndex < DBFGetFieldCount(_dbfHandle); ++fieldIndex)
+    {
+        char name[12];
+        std::unique_ptr<Field> field(new Field());
+
+        switch (DBFGetFieldInfo(_dbfHandle, fieldIndex, name, nullptr, nullptr))
+        {
+        case FTInteger:
+            field->type = ColumnType::Integer;
+            break;
+
+        case FTDouble:
+            field->type = ColumnType::Double;
+            break;
+
+        case FTLogical:
+            field->type = ColumnType::Bool;
+            break;
+
+        default:
+            field->type = ColumnType::String;
+            break;
+        }
+
+        field->name = name;
+        field->ready = false;
+        _fields.push_back(std::move(field));
+    }
+}
+
+Dataset::AttributeColumns::~AttributeColumns()
+{
+    if (_dbfHandle)
+        DBFClose(_dbfHandle);
+}
+
+int Dataset::AttributeColumns::fieldIndex(std::string const& name) const
+{
+    return _dbfHandle ? DBFGetFieldIndex(_dbfHandle, name.c_str()) : -1;
+}
+
+Dataset::AttributeColumns::Column const& Dataset::AttributeColumns::column(int field) const
+{
+    Field const& target = *_fields[field];
+
+    std::call_once(target.parsed, [this, field, &target]()
+    {
+        parse(field, target.column);
+        target.ready = true;
+    });
+
+    return target.column;
+}
+
+std::size_t Dataset::AttributeColumns::memoryUsage() const
+{
+    std::size_t usage = 0;
+    for (auto const& field : _fields)
+        if (field->ready)
+            usage += field->column.memoryUsage();
+
+    return usage;
+}
+
+int Dataset::AttributeColumns::parseThreadCount() const
+{
+    int const minRecordsPerThread = 16384;
+
+    int threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+    return std::min(threadCount, std::max(1, _recordCount / minRecordsPerThread));
+}
+
+// Every thread parses its own range of records. The ranges start on a multiple
+// of 64 records, so no two threads write to the same word of a bitmap. A mapped
+// handle is only read from and is shared, otherwise each range opens its own.
+// Strings are collected into a dictionary per range, merged and sorted at the end.
+void Dataset::AttributeColumns::parse(int field, Column& column) const
+{
+    static int const BlockSize = 4096; // Records parsed per column read.
+
+    int const recordCount = _recordCount;
+    std::size_t const wordCount = (std::size_t(recordCount) + 63) / 64;
+
+    column.type = _fields[field]->type;
+    column.nullBits.assign(wordCount, 0);
+
+    switch (column.type)
+    {
+    case ColumnType::Integer:
+        column.integers.resize(recordCount);
+        break;
+
+    case ColumnType::Double:
+        column.doubles.resize(recordCount);
+        break;
+
+    case ColumnType::String:
+        column.codes.resize(recordCount);
+        break;
+
+    case ColumnType::Bool:
+        column.trueBits.assign(wordCount, 0);
+        break;
+    }
+
+    int const threadCount = parseThreadCount();
+    std::vector<int> rangeStarts(threadCount + 1, recordCount);
+    for (int i = 0; i < threadCount; ++i)
+        rangeStarts[i] = int((recordCount * (long long)i / threadCount) & ~63LL);
+
+    std::vector<std::vector<std::string>> rangeDictionaries(threadCount);
+
+    auto parseRange = [&](int threadIndex)
+    {
+        int const first = rangeStarts[threadIndex];
+        int const last = rangeStarts[threadIndex + 1];
+
+        auto setBit = [](std::vector<std::uint64_t>& bits, int record) { bits[record >> 6] |= std::uint64_t(1) << (record & 63); };
+
+        DBFHandle handle = _dbfHandle->bMapped ? _dbfHandle : DBFOpen(_path.c_str(), "rb");
+        if (handle == nullptr)
+        {
+            for (int record = first; record < last; ++record)
+                setBit(column.nullBits, record);
+            if (column.type == ColumnType::String)
+                std::fill(column.codes.begin() + first, column.codes.begin() + last, -1);
+            return;
+        }
+
+        if (column.type == ColumnType::String)
+        {
+            std::unordered_map<std::string, int> rangeCodes;
+            std::vector<std::string>& rangeDictionary = rangeDictionaries[threadIndex];
+
+            for (int record = first; record < last; ++record)
+            {
+                int length = 0;
+                char const* begin = DBFReadFieldSlice(handle, record, field, &length);
+                char const* end = begin ? begin + length : nullptr;
+
+                while (begin != end && *begin == ' ')
+                    ++begin;
+                while (begin != end && (end[-1] == ' ' || end[-1] == '\0'))
+                    --end;
+
+                if (begin == end)
+                {
+                    setBit(column.nullBits, record);
+                    column.codes[record] = -1;
+                    continue;
+                }
+
+                auto inserted = rangeCodes.emplace(std::string(begin, end), int(rangeDictionary.size()));
+                if (inserted.second)
+                    rangeDictionary.push_back(inserted.first->first);
+                column.codes[record] = inserted.first->second;
+            }
+        }
+        else if (column.type == ColumnType::Integer)
+        {
+            // Parsed digit by digit, a double would round ids past 2^53.
+            std::vector<unsigned char> isNull(BlockSize);
+
+            for (int block = first; block < last; block += BlockSize)
+            {
+                int count = std::min(BlockSize, last - block);
+                if (DBFReadInteger64Column(handle, field, block, count, column.integers.data() + block, isNull.data()) != count)
+                {
+                    std::fill(column.integers.begin() + block, column.integers.begin() + block + count, 0LL);
+                    std::fill(isNull.begin(), isNull.end(), 1);
+                }
+
+                for (int i = 0; i < count; ++i)
+                    if (isNull[i])
+                        setBit(column.nullBits, block + i);
+            }
+        }
+        else
+        {
+            std::vector<double> values(BlockSize);
+            std::vector<unsigned char> isNull(BlockSize);
+
+            for (int block = first; block < last; block += BlockSize)
+            {
+                int count = std::min(BlockSize, last - block);
+                if (DBFReadDoubleColumn(handle, field, block, count, values.data(), isNull.data()) != count)
+                {
+                    std::fill(values.begin(), values.end(), 0.0);
+                    std::fill(isNull.begin(), isNull.end(), 1);
+                }
+
+                for (int i = 0; i < count; ++i)
+                {
+                    int record = block + i;
+                    if (isNull[i])
+                        setBit(column.nullBits, record);
+
+                    double value = isNull[i] ? 0.0 : values[i];
+                    switch (column.type)
+                    {
+                    case ColumnType::Double:
+                        column.doubles[record] = value;
+                        break;
+
+                    default:
+                        if (value != 0.0)
+                            setBit(column.trueBits, record);
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (handle != _dbfHandle)
+            DBFClose(handle);
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; ++i)
+        workers.emplace_back(parseRange, i);
+
+    parseRange(0);
+
+    for (auto& worker : workers)
+        worker.join();
+
+    if (column.type != ColumnType::String)
+        return;
+
+    // One sorted dictionary, so that codes compare as their strings do.
+    for (auto& rangeDictionary : rangeDictionaries)
+        column.dictionary.insert(column.dictionary.end(), rangeDictionary.begin(), rangeDictionary.end());
+    std::sort(column.dictionary.begin(), column.dictionary.end());
+    column.dictionary.erase(std::unique(column.dictionary.begin(), column.dictionary.end()), column.dictionary.end());
+    column.dictionary.shrink_to_fit();
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        std::vector<int> toSorted;
+        for (auto const& value : rangeDictionaries[i])
+            toSorted.push_back(int(std::lower_bound(column.dictionary.begin(), column.dictionary.end(), value)
+                                   - column.dictionary.begin()));
+
+        for (int record = rangeStarts[i]; record < rangeStarts[i + 1]; ++record)
+            if (column.codes[record] >= 0)
+                column.codes[record] = toSorted[column.codes[record]];
+    }
+}
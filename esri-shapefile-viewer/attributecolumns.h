@@ -0,0 +1,86 @@
+#ifndef ATTRIBUTECOLUMNS_H
+#define ATTRIBUTECOLUMNS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../shapelib/shapefil.h"
+#include "nsdef.h"
+
+// The attributes of a dataset as typed columns, one contiguous array per field,
+// so that styling, filtering and statistics run over numbers instead of text.
+// A column is parsed from the .dbf the first time it is asked for, by several
+// threads each over a range of records, and kept as long as the dataset.
+class cl::Dataset::AttributeColumns
+{
+public:
+    enum class ColumnType { Integer, Double, String, Bool };
+
+    // One field of every record. Which arrays are filled depends on the type,
+    // the null bits are kept for all of them.
+    struct Column
+    {
+        ColumnType type;
+        std::vector<long long> integers;      // Integer, zero if null.
+        std::vector<double> doubles;          // Double, zero if null.
+        std::vector<int> codes;               // String, the index into the dictionary, -1 if null.
+        std::vector<std::string> dictionary;  // String, every distinct value once, sorted.
+        std::vector<std::uint64_t> trueBits;  // Bool, one bit per record, set if true.
+        std::vector<std::uint64_t> nullBits;  // One bit per record, set if null.
+
+        bool isNull(int record) const { return (nullBits[record >> 6] >> (record & 63)) & 1; }
+        bool isTrue(int record) const { return (trueBits[record >> 6] >> (record & 63)) & 1; }
+
+        // An Integer, Double or Bool value as a double, zero for a string.
+        double number(int record) const;
+
+        std::size_t memoryUsage() const;
+    };
+
+    // The .dbf next to the .shp at shpPath, mapped if possible. Only the
+    // header is read here.
+    explicit AttributeColumns(std::string const& shpPath);
+    ~AttributeColumns();
+
+    AttributeColumns(AttributeColumns const&) = delete;
+    AttributeColumns& operator= (AttributeColumns const&) = delete;
+
+    bool isOpen() const { return _dbfHandle != nullptr; }
+    int recordCount() const { return _recordCount; }
+    int fieldCount() const { return int(_fields.size()); }
+    std::string const& fieldName(int field) const { return _fields[field]->name; }
+    ColumnType fieldType(int field) const { return _fields[field]->type; }
+
+    // The field of that name, ignoring case as dBASE does, or -1.
+    int fieldIndex(std::string const& name) const;
+
+    // Parsed on first use. Safe to call from several threads.
+    Column const& column(int field) const;
+
+    // The bytes held by the columns parsed so far.
+    std::size_t memoryUsage() const;
+
+private:
+    struct Field
+    {
+        std::string name;
+        ColumnType type;
+        mutable std::once_flag parsed;
+        mutable std::atomic<bool> ready; // Set once parsed, memoryUsage() may run on another thread.
+        mutable Column column;
+    };
+
+    int parseThreadCount() const;
+    void parse(int field, Column& column) const;
+
+    std::string _path;
+    DBFHandle _dbfHandle;
+    int _recordCount;
+    std::vector<std::unique_ptr<Field>> _fields;
+};
+
+#endif // ATTRIBUTECOLUMNS_H
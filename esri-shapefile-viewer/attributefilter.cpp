@@ -0,0 +1,508 @@
+#include "attributefilter.h"
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <locale>
+#include <sstream>
+#include "attributecolumns.h"
+
+using namespace cl;
+
+namespace
+{
+typedef std::vector<std::uint64_t> Bitmap;
+
+enum class CompareOp { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+// One node of a parsed expression, its children come before it.
+struct Node
+{
+    enum Kind { And, Or, Not, Compare, IsNull };
+
+    Kind kind;
+    int left, right;    // And, Or and Not, the only child of Not on the left.
+    int field;          // Compare and IsNull.
+    CompareOp op;
+    double number;      // Compared with a numeric field.
+    std::string text;   // Compared with a string field.
+};
+
+// The records a node holds for and those it cannot tell, having met a null,
+// it fails for the rest.
+struct Truth
+{
+    Bitmap trueBits;
+    Bitmap unknownBits;
+};
+
+class Parser
+{
+public:
+    Parser(Dataset::AttributeColumns const& attributes, std::string const& expression)
+        : _attributes(attributes), _expression(expression), _position(0) {}
+
+    // The index of the root in nodes, or -1 with the reason in error.
+    int parse(std::vector<Node>& nodes, std::string& error);
+
+private:
+    enum class Token { End, Identifier, Number, String, Operator, Sign, LeftParen, RightParen, Invalid };
+
+    void next();
+    bool isKeyword(char const* keyword) const;
+    int fail(std::string const& message);
+    int add(Node const& node) { _nodes->push_back(node); return int(_nodes->size()) - 1; }
+
+    int parseOr();
+    int parseAnd();
+    int parseNot();
+    int parsePrimary();
+
+    Dataset::AttributeColumns const& _attributes;
+    std::string const& _expression;
+    std::size_t _position;
+
+    Token _token;
+    std::string _tokenText;
+    double _tokenNumber;
+    std::size_t _tokenStart;
+
+    std::vector<Node>* _nodes;
+    std::string _error;
+};
+
+int Parser::parse(std::vector<Node>& nodes, std::string& error)
+{
+    _nodes = &nodes;
+
+    next();
+    int root = parseOr();
+    if (root >= 0 && _token != Token::End)
+        root = fail("Unexpected '" + _tokenText + "'");
+
+    error = _error;
+    return root;
+}
+
+void Parser::next()
+{
+    while (_position < _expression.size() && std::isspace((unsigned char)_expression[_position]))
+        ++_position;
+
+    _tokenStart = _position;
+    _tokenText.clear();
+
+    if (_position == _expression.size())
+    {
+        _token = Token::End;
+        return;
+    }
+
+    char const c = _expression[_position];
+    char const following = _position + 1 < _expression.size() ? _expression[_position + 1] : '\0';
+
+    if (std::isalpha((unsigned char)c) || c == '_')
+    {
+        while (_position < _expression.size()
+               && (std::isalnum((unsigned char)_expression[_position]) || _expression[_position] == '_'))
+            _tokenText += _expression[_position++];
+        _token = Token::Identifier;
+    }
+    else if (std::isdigit((unsigned char)c) || (c == '.' && std::isdigit((unsigned char)following)))
+    {
+        // Digits, a point and digits, an exponent. Read in the C locale, not the
+        // user's, whose decimal separator may be a comma.
+        auto isDigitAt = [this](std::size_t position)
+        {
+            return position < _expression.size() && std::isdigit((unsigned char)_expression[position]);
+        };
+
+        std::size_t end = _position;
+        while (isDigitAt(end))
+            ++end;
+        if (end < _expression.size() && _expression[end] == '.')
+            for (++end; isDigitAt(end); ++end) {}
+        if (end < _expression.size() && (_expression[end] == 'e' || _expression[end] == 'E'))
+        {
+            std::size_t exponent = end + 1;
+            if (exponent < _expression.size() && (_expression[exponent] == '+' || _expression[exponent] == '-'))
+                ++exponent;
+            if (isDigitAt(exponent))
+                for (end = exponent; isDigitAt(end); ++end) {}
+        }
+
+        _tokenText = _expression.substr(_position, end - _position);
+        _position = end;
+
+        std::istringstream stream(_tokenText);
+        stream.imbue(std::locale::classic());
+        stream >> _tokenNumber;
+        _token = stream.fail() ? Token::Invalid : Token::Number;
+    }
+    else if (c == '\'')
+    {
+        // A quote within the string is written twice.
+        _token = Token::Invalid;
+        for (++_position; _position < _expression.size(); ++_position)
+        {
+            if (_expression[_position] != '\'')
+                _tokenText += _expression[_position];
+            else if (_position + 1 < _expression.size() && _expression[_position + 1] == '\'')
+                _tokenText += _expression[++_position];
+            else
+            {
+                ++_position;
+                _token = Token::String;
+                break;
+            }
+        }
+
+        if (_token == Token::Invalid)
+            fail("Unterminated string");
+    }
+    else if ((c == '<' && (following == '=' || following == '>')) || (c == '>' && following == '=')
+             || (c == '!' && following == '='))
+    {
+        _tokenText = _expression.substr(_position, 2);
+        _position += 2;
+        _token = Token::Operator;
+    }
+    else
+    {
+        _tokenText = std::string(1, c);
+        ++_position;
+        _token = c == '=' || c == '<' || c == '>' ? Token::Operator
+               : c == '-' || c == '+' ? Token::Sign
+               : c == '(' ? Token::LeftParen
+               : c == ')' ? Token::RightParen
+               : Token::Invalid;
+    }
+}
+
+bool Parser::isKeyword(char const* keyword) const
+{
+    if (_token != Token::Identifier)
+        return false;
+
+    std::string upper = _tokenText;
+    std::transform(upper.begin(), upper.end(), upper.begin(), [](char c) { return char(std::toupper((unsigned char)c)); });
+    return upper == keyword;
+}
+
+int Parser::fail(std::string const& message)
+{
+    if (_error.empty())
+        _error = message + " at position " + std::to_string(_tokenStart + 1) + ".";
+    return -1;
+}
+
+int Parser::parseOr()
+{
+    int left = parseAnd();
+    while (left >= 0 && isKeyword("OR"))
+    {
+        next();
+        int right = parseAnd();
+        if (right < 0)
+            return -1;
+
+        left = add({Node::Or, left, right, -1, CompareOp::Equal, 0.0, std::string()});
+    }
+    return left;
+}
+
+int Parser::parseAnd()
+{
+    int left = parseNot();
+    while (left >= 0 && isKeyword("AND"))
+    {
+        next();
+        int right = parseNot();
+        if (right < 0)
+            return -1;
+
+        left = add({Node::And, left, right, -1, CompareOp::Equal, 0.0, std::string()});
+    }
+    return left;
+}
+
+int Parser::parseNot()
+{
+    if (!isKeyword("NOT"))
+        return parsePrimary();
+
+    next();
+    int child = parseNot();
+    if (child < 0)
+        return -1;
+
+    return add({Node::Not, child, -1, -1, CompareOp::Equal, 0.0, std::string()});
+}
+
+int Parser::parsePrimary()
+{
+    typedef Dataset::AttributeColumns::ColumnType ColumnType;
+
+    if (_token == Token::LeftParen)
+    {
+        next();
+        int inner = parseOr();
+        if (inner < 0)
+            return -1;
+        if (_token != Token::RightParen)
+            return fail("Expected ')'");
+
+        next();
+        return inner;
+    }
+
+    if (_token != Token::Identifier || isKeyword("AND") || isKeyword("OR") || isKeyword("IS") || isKeyword("NULL"))
+        return fail(_token == Token::End ? "Expected a field name" : "Expected a field name instead of '" + _tokenText + "'");
+
+    int field = _attributes.fieldIndex(_tokenText);
+    if (field < 0)
+        return fail("No field named " + _tokenText);
+
+    std::string fieldName = _tokenText;
+    next();
+
+    // field IS [NOT] NULL
+    if (isKeyword("IS"))
+    {
+        next();
+        bool negated = isKeyword("NOT");
+        if (negated)
+            next();
+        if (!isKeyword("NULL"))
+            return fail("Expected NULL");
+        next();
+
+        int isNull = add({Node::IsNull, -1, -1, field, CompareOp::Equal, 0.0, std::string()});
+        return negated ? add({Node::Not, isNull, -1, -1, CompareOp::Equal, 0.0, std::string()}) : isNull;
+    }
+
+    if (_token != Token::Operator)
+        return fail("Expected a comparison after " + fieldName);
+
+    CompareOp op = _tokenText == "=" ? CompareOp::Equal
+                 : _tokenText == "<>" || _tokenText == "!=" ? CompareOp::NotEqual
+                 : _tokenText == "<" ? CompareOp::Less
+                 : _tokenText == "<=" ? CompareOp::LessEqual
+                 : _tokenText == ">" ? CompareOp::Greater
+                 : CompareOp::GreaterEqual;
+    next();
+
+    if (_attributes.fieldType(field) == ColumnType::String)
+    {
+        if (_token != Token::String)
+            return fail(fieldName + " is a string field, compare it with a quoted string");
+
+        Node node = {Node::Compare, -1, -1, field, op, 0.0, _tokenText};
+        next();
+        return add(node);
+    }
+
+    double sign = 1.0;
+    if (_token == Token::Sign)
+    {
+        sign = _tokenText == "-" ? -1.0 : 1.0;
+        next();
+    }
+
+    if (_token != Token::Number)
+        return fail(fieldName + " is a numeric field, compare it with a number");
+
+    Node node = {Node::Compare, -1, -1, field, op, sign * _tokenNumber, std::string()};
+    next();
+    return add(node);
+}
+
+// The comparison of every record, 64 to a word. The inner loop has no branch,
+// so the compiler can vectorize it.
+template<typename Value, typename Compare>
+void compareWords(Value const* values, int recordCount, Compare compare, Bitmap& bits)
+{
+    for (std::size_t word = 0; word < bits.size(); ++word)
+    {
+        int const first = int(word) * 64;
+        int const count = std::min(64, recordCount - first);
+
+        std::uint64_t result = 0;
+        for (int i = 0; i < count; ++i)
+            result |= std::uint64_t(compare(values[first + i])) << i;
+
+        bits[word] = result;
+    }
+}
+
+template<typename Value, typename Literal>
+void compareColumn(Value const* values, int recordCount, CompareOp op, Literal literal, Bitmap& bits)
+{
+    switch (op)
+    {
+    case CompareOp::Equal:
+        compareWords(values, recordCount, [literal](Value value) { return value == literal; }, bits);
+        break;
+
+    case CompareOp::NotEqual:
+        compareWords(values, recordCount, [literal](Value value) { return value != literal; }, bits);
+        break;
+
+    case CompareOp::Less:
+        compareWords(values, recordCount, [literal](Value value) { return value < literal; }, bits);
+        break;
+
+    case CompareOp::LessEqual:
+        compareWords(values, recordCount, [literal](Value value) { return value <= literal; }, bits);
+        break;
+
+    case CompareOp::Greater:
+        compareWords(values, recordCount, [literal](Value value) { return value > literal; }, bits);
+        break;
+
+    case CompareOp::GreaterEqual:
+        compareWords(values, recordCount, [literal](Value value) { return value >= literal; }, bits);
+        break;
+    }
+}
+
+// A string compares with the codes of the sorted dictionary: those before the
+// first entry not below it are less, and it equals that entry or none.
+void compareStrings(Dataset::AttributeColumns::Column const& column, int recordCount,
+                    CompareOp op, std::string const& text, Bitmap& bits)
+{
+    auto const& dictionary = column.dictionary;
+    int position = int(std::lower_bound(dictionary.begin(), dictionary.end(), text) - dictionary.begin());
+    bool found = position < int(dictionary.size()) && dictionary[position] == text;
+
+    if (op == CompareOp::Equal || op == CompareOp::NotEqual)
+        position = found ? position : -2; // No code, nulls are -1.
+    else if (op == CompareOp::LessEqual && !found)
+        op = CompareOp::Less;
+    else if (op == CompareOp::Greater && !found)
+        op = CompareOp::GreaterEqual;
+
+    compareColumn(column.codes.data(), recordCount, op, position, bits);
+}
+
+Truth evaluate(std::vector<Node> const& nodes, int index, Dataset::AttributeColumns const& attributes)
+{
+    typedef Dataset::AttributeColumns::ColumnType ColumnType;
+
+    Node const& node = nodes[index];
+    int const recordCount = attributes.recordCount();
+    std::size_t const wordCount = (std::size_t(recordCount) + 63) / 64;
+
+    Truth truth;
+
+    switch (node.kind)
+    {
+    case Node::And:
+    case Node::Or:
+    {
+        Truth left = evaluate(nodes, node.left, attributes);
+        Truth right = evaluate(nodes, node.right, attributes);
+        truth.trueBits.resize(wordCount);
+        truth.unknownBits.resize(wordCount);
+
+        for (std::size_t word = 0; word < wordCount; ++word)
+        {
+            if (node.kind == Node::And)
+            {
+                // Unknown unless either side is false.
+                truth.trueBits[word] = left.trueBits[word] & right.trueBits[word];
+                truth.unknownBits[word] = (left.trueBits[word] | left.unknownBits[word])
+                        & (right.trueBits[word] | right.unknownBits[word]) & ~truth.trueBits[word];
+            }
+            else
+            {
+                truth.trueBits[word] = left.trueBits[word] | right.trueBits[word];
+                truth.unknownBits[word] = (left.unknownBits[word] | right.unknownBits[word]) & ~truth.trueBits[word];
+            }
+        }
+        break;
+    }
+
+    case Node::Not:
+    {
+        truth = evaluate(nodes, node.left, attributes);
+        for (std::size_t word = 0; word < wordCount; ++word)
+            truth.trueBits[word] = ~(truth.trueBits[word] | truth.unknownBits[word]);
+
+        // No record past the last.
+        if (recordCount % 64 != 0)
+            truth.trueBits.back() &= (std::uint64_t(1) << (recordCount % 64)) - 1;
+        break;
+    }
+
+    case Node::IsNull:
+        truth.trueBits = attributes.column(node.field).nullBits;
+        truth.unknownBits.assign(wordCount, 0);
+        break;
+
+    case Node::Compare:
+    {
+        Dataset::AttributeColumns::Column const& column = attributes.column(node.field);
+        truth.trueBits.resize(wordCount);
+
+        switch (column.type)
+        {
+        case ColumnType::Integer:
+            compareColumn(column.integers.data(), recordCount, node.op, node.number, truth.trueBits);
+            break;
+
+        case ColumnType::Double:
+            compareColumn(column.doubles.data(), recordCount, node.op, node.number, truth.trueBits);
+            break;
+
+        case ColumnType::String:
+            compareStrings(column, recordCount, node.op, node.text, truth.trueBits);
+            break;
+
+        case ColumnType::Bool:
+        {
+            std::vector<double> values(recordCount);
+            for (int record = 0; record < recordCount; ++record)
+                values[record] = column.number(record);
+            compareColumn(values.data(), recordCount, node.op, node.number, truth.trueBits);
+            break;
+        }
+        }
+
+        truth.unknownBits = column.nullBits;
+        for (std::size_t word = 0; word < wordCount; ++word)
+            truth.trueBits[word] &= ~truth.unknownBits[word];
+        break;
+    }
+    }
+
+    return truth;
+}
+}
+
+Dataset::AttributeFilter::AttributeFilter(AttributeColumns const& attributes, std::string const& expression)
+    : _expression(expression), _selectedCount(0)
+{
+    _selectedBits.assign((std::size_t(attributes.recordCount()) + 63) / 64, 0);
+
+    if (!attributes.isOpen())
+    {
+        _error = "The layer has no readable .dbf file.";
+        return;
+    }
+
+    std::vector<Node> nodes;
+    int root = Parser(attributes, expression).parse(nodes, _error);
+    if (root < 0)
+        return;
+
+    _selectedBits = evaluate(nodes, root, attributes).trueBits;
+
+    for (auto word : _selectedBits)
+        _selectedCount += int(std::bitset<64>(word).count());
+}
+
+void Dataset::AttributeFilter::removeUnselected(std::vector<int>& records) const
+{
+    records.erase(std::remove_if(records.begin(), records.end(), [this](int recordId) { return !isSelected(recordId); }),
+                  records.end());
+}
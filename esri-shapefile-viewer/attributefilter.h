@@ -0,0 +1,47 @@
+#ifndef ATTRIBUTEFILTER_H
+#define ATTRIBUTEFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "nsdef.h"
+
+// A definition query over the attributes of a dataset, such as
+//     POP2005 > 1e6 AND (REGION = 150 OR NAME <> 'Chile') AND AREA IS NOT NULL
+// Fields are compared with numbers, or string fields with quoted strings,
+// by = <> != < <= > >=, and combined with AND, OR, NOT and parentheses.
+// The expression is parsed once and evaluated over whole columns, a word of
+// 64 records at a time, into a bitmap of the records selected, so that a draw
+// drops the others before reading any geometry. A null value makes a comparison
+// unknown and the record is left out, as in SQL, as is a record the .dbf has no row for.
+class cl::Dataset::AttributeFilter
+{
+public:
+    // Parse the expression and select the records it holds for.
+    AttributeFilter(AttributeColumns const& attributes, std::string const& expression);
+
+    // False if the expression could not be parsed, nothing is selected then.
+    bool isValid() const { return _error.empty(); }
+    std::string const& error() const { return _error; }
+    std::string const& expression() const { return _expression; }
+
+    int selectedCount() const { return _selectedCount; }
+    bool isSelected(int recordId) const
+    {
+        return std::size_t(recordId >> 6) < _selectedBits.size() && ((_selectedBits[recordId >> 6] >> (recordId & 63)) & 1);
+    }
+
+    // Drop the records not selected, keeping the order of the rest.
+    void removeUnselected(std::vector<int>& records) const;
+
+    std::size_t memoryUsage() const { return _selectedBits.capacity() * sizeof(std::uint64_t); }
+
+private:
+    std::string _expression;
+    std::string _error;
+    std::vector<std::uint64_t> _selectedBits;
+    int _selectedCount;
+};
+
+#endif // ATTRIBUTEFILTER_H
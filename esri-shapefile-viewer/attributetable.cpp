@@ -0,0 +1,37 @@
+#include "attributetable.h"
+#include "ui_attributetable.h"
+#include <QHeaderView>
+#include <QTableView>
+#include "attributetablemodel.h"
+
+AttributeTable::AttributeTable(QWidget* parent)
+    : QDockWidget(parent), ui(new Ui::AttributeTable)
+{
+    ui->setupUi(this);
+
+    // Rows of one fixed height, so the view never measures rows it does not show.
+    QHeaderView* rowHeader = ui->tableView->verticalHeader();
+    rowHeader->setSectionResizeMode(QHeaderView::Fixed);
+    rowHeader->setDefaultSectionSize(rowHeader->minimumSectionSize());
+}
+
+AttributeTable::~AttributeTable()
+{
+    ui->tableView->setModel(nullptr);
+}
+
+bool AttributeTable::showDataset(std::string const& name, std::string const& shpPath)
+{
+    std::unique_ptr<AttributeTableModel> model(new AttributeTableModel(shpPath));
+    if (!model->isOpen())
+        return false;
+
+    ui->tableView->setModel(model.get());
+    _model = std::move(model);
+
+    setWindowTitle(tr("Attributes - ") + QString::fromStdString(name));
+    show();
+    raise();
+
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef ATTRIBUTETABLE_H
+#define ATTRIBUTETABLE_H
+
+#include <QDockWidget>
+#include <memory>
+#include <string>
+
+class AttributeTableModel;
+
+namespace Ui { class AttributeTable; }
+
+// The attributes of one layer, read from its .dbf as the table scrolls.
+class AttributeTable : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    explicit AttributeTable(QWidget* parent = nullptr);
+    ~AttributeTable();
+
+    // Show the records of the .dbf next to shpPath, false if it cannot be opened.
+    bool showDataset(std::string const& name, std::string const& shpPath);
+
+private:
+    std::unique_ptr<Ui::AttributeTable> ui;
+    std::unique_ptr<AttributeTableModel> _model;
+};
+
+#endif // ATTRIBUTETABLE_H
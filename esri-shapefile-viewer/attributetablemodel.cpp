@@ -0,0 +1,124 @@
+#include "attributetablemodel.h"
+#include <algorithm>
+#include <cstring>
+
+int const AttributeTableModel::PageSize;
+int const AttributeTableModel::CachedPageCount;
+
+AttributeTableModel::AttributeTableModel(std::string const& shpPath, QObject* parent)
+    : QAbstractTableModel(parent), _dbfHandle(nullptr)
+{
+    // DBFOpen() swaps the extension for .dbf itself. The file is mapped where
+    // possible, its fields are then read in place and no page is cached.
+    _dbfHandle = DBFOpen(shpPath.c_str(), "rbm");
+    if (_dbfHandle == nullptr)
+        return;
+
+    for (int fieldIndex = 0; fieldIndex < DBFGetFieldCount(_dbfHandle); ++fieldIndex)
+    {
+        char name[12];
+        int width, decimals;
+        DBFFieldType type = DBFGetFieldInfo(_dbfHandle, fieldIndex, name, &width, &decimals);
+
+        _fields.push_back({QString::fromLatin1(name), type, _dbfHandle->panFieldOffset[fieldIndex], width});
+    }
+}
+
+AttributeTableModel::~AttributeTableModel()
+{
+    if (_dbfHandle)
+        DBFClose(_dbfHandle);
+}
+
+int AttributeTableModel::rowCount(QModelIndex const& parent) const
+{
+    return parent.isValid() || !_dbfHandle ? 0 : DBFGetRecordCount(_dbfHandle);
+}
+
+int AttributeTableModel::columnCount(QModelIndex const& parent) const
+{
+    return parent.isValid() ? 0 : int(_fields.size());
+}
+
+QVariant AttributeTableModel::data(QModelIndex const& index, int role) const
+{
+    if (!index.isValid() || !_dbfHandle)
+        return QVariant();
+
+    Field const& field = _fields[index.column()];
+    bool numeric = field.type == FTInteger || field.type == FTDouble;
+
+    if (role == Qt::TextAlignmentRole)
+        return int((numeric ? Qt::AlignRight : Qt::AlignLeft) | Qt::AlignVCenter);
+
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    char const* slice;
+    if (_dbfHandle->bMapped)
+    {
+        slice = DBFReadFieldSlice(_dbfHandle, index.row(), index.column(), nullptr);
+        if (!slice)
+            return QVariant();
+    }
+    else
+    {
+        std::vector<char> const& rows = page(index.row() / PageSize);
+        slice = rows.data() + std::size_t(index.row() % PageSize) * _dbfHandle->nRecordLength + field.offset;
+    }
+
+    QString value = QString::fromLatin1(slice, field.width).trimmed();
+
+    // A number of nothing but asterisks is the .dbf's null.
+    if (numeric && value.startsWith('*'))
+        return QVariant();
+
+    return value;
+}
+
+QVariant AttributeTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    if (orientation == Qt::Horizontal)
+        return section < int(_fields.size()) ? _fields[section].name : QVariant();
+
+    return section; // The record number, as in the .shp.
+}
+
+std::vector<char> const& AttributeTableModel::page(int pageIndex) const
+{
+    auto found = _pageIndex.find(pageIndex);
+    if (found != _pageIndex.end())
+    {
+        _pages.splice(_pages.begin(), _pages, found->second);
+        return found->second->second;
+    }
+
+    // Reuse the buffer of the least recently used page once the cache is full.
+    std::vector<char> tuples;
+    if (int(_pages.size()) >= CachedPageCount)
+    {
+        tuples.swap(_pages.back().second);
+        _pageIndex.erase(_pages.back().first);
+        _pages.pop_back();
+    }
+
+    int const recordLength = _dbfHandle->nRecordLength;
+    int const firstRow = pageIndex * PageSize;
+    int const rowCount = std::min(PageSize, DBFGetRecordCount(_dbfHandle) - firstRow);
+
+    tuples.assign(std::size_t(rowCount) * recordLength, ' ');
+    for (int row = 0; row < rowCount; ++row)
+    {
+        char const* tuple = DBFReadTuple(_dbfHandle, firstRow + row);
+        if (tuple)
+            std::memcpy(&tuples[std::size_t(row) * recordLength], tuple, recordLength);
+    }
+
+    _pages.emplace_front(pageIndex, std::move(tuples));
+    _pageIndex[pageIndex] = _pages.begin();
+
+    return _pages.front().second;
+}
@@ -0,0 +1,56 @@
+#ifndef ATTRIBUTETABLEMODEL_H
+#define ATTRIBUTETABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../shapelib/shapefil.h"
+
+// The records of a .dbf as a table, one row per record and one column per field.
+// A mapped .dbf is read in place. Otherwise rows are read on demand a page at a
+// time as raw tuples, and only the pages last used are kept, so a view scrolls
+// through millions of rows at the cost of the rows on screen.
+class AttributeTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    // The .dbf next to the .shp at shpPath.
+    explicit AttributeTableModel(std::string const& shpPath, QObject* parent = nullptr);
+    ~AttributeTableModel();
+
+    bool isOpen() const { return _dbfHandle != nullptr; }
+
+    virtual int rowCount(QModelIndex const& parent = QModelIndex()) const override;
+    virtual int columnCount(QModelIndex const& parent = QModelIndex()) const override;
+    virtual QVariant data(QModelIndex const& index, int role = Qt::DisplayRole) const override;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    static int const PageSize = 256;       // Rows read at once.
+    static int const CachedPageCount = 16; // Pages kept, a few screens either way.
+
+    struct Field
+    {
+        QString name;
+        DBFFieldType type;
+        int offset; // Into a tuple, past the deletion flag.
+        int width;
+    };
+
+    typedef std::pair<int, std::vector<char>> Page; // The page number and its tuples back to back.
+
+    // The tuples of a page, read unless cached.
+    std::vector<char> const& page(int pageIndex) const;
+
+    DBFHandle _dbfHandle;
+    std::vector<Field> _fields;
+
+    mutable std::list<Page> _pages; // The most recently used first.
+    mutable std::unordered_map<int, std::list<Page>::iterator> _pageIndex;
+};
+
+#endif // ATTRIBUTETABLEMODEL_H
@@ -0,0 +1,291 @@
+#include "benchmark.h"
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QPoint>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include "../shapelib/shapefil.h"
+#include "shapedata.h"
+#include "datasetregistry.h"
+#include "shapemanager.h"
+#include "tilecache.h"
+#include "workstealingpool.h"
+
+using namespace cl;
+
+QString Benchmark::spatialIndex(DataManagement::ShapeDoc const& shapeDoc, Rect<double> const& window, int queryCount)
+{
+    using Dataset::IndexType;
+
+    QString report;
+
+    for (auto const& layer : shapeDoc.layers())
+    {
+        auto const& dataset = layer->dataset();
+        Rect<double> const& bounds = dataset->bounds();
+
+        // A fixed seed keeps the windows identical between runs and between the indexes.
+        std::mt19937 generator(20170420);
+        std::uniform_real_distribution<double> xDistribution(bounds.xMin(), bounds.xMax());
+        std::uniform_real_distribution<double> yDistribution(bounds.yMin(), bounds.yMax());
+
+        Pair<double> halfRange = window.range() * 0.5;
+        std::vector<Rect<double>> windows;
+        for (int i = 0; i < queryCount; ++i)
+        {
+            Pair<double> center(xDistribution(generator), yDistribution(generator));
+            windows.push_back(Rect<double>(center - halfRange, center + halfRange));
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        dataset->packedRTree();
+        qint64 buildTime = timer.elapsed();
+
+        report += QString("%1 (%2 records, R-tree built in %3 ms, %4 KB)\n")
+                .arg(QString::fromStdString(dataset->name()))
+                .arg(dataset->recordCount())
+                .arg(buildTime)
+                .arg(dataset->packedRTree().memoryUsage() / 1024);
+
+        for (IndexType indexType : {IndexType::QuadTree, IndexType::PackedRTree})
+        {
+            long long candidateCount = 0;
+
+            timer.restart();
+            for (auto const& queryWindow : windows)
+                candidateCount += dataset->filterRecords(queryWindow, indexType).size();
+            qint64 elapsed = timer.nsecsElapsed();
+
+            report += QString("    %1: %2 candidates, %3 us per query\n")
+                    .arg(indexType == IndexType::QuadTree ? "Quadtree" : "Packed R-tree", -13)
+                    .arg(double(candidateCount) / queryCount, 0, 'f', 1)
+                    .arg(elapsed / 1000.0 / queryCount, 0, 'f', 1);
+        }
+    }
+
+    return report;
+}
+
+QString Benchmark::transformKernel(Graphics::GraphicAssistant const& assistant, int vertexCount, int passCount)
+{
+    Rect<double> window = assistant.computeMapHitBounds();
+
+    std::mt19937 generator(20170420);
+    std::uniform_real_distribution<double> xDistribution(window.xMin(), window.xMax());
+    std::uniform_real_distribution<double> yDistribution(window.yMin(), window.yMax());
+
+    // The same vertices, interleaved little-endian as in a record and as separate x and y arrays.
+    std::vector<unsigned char> interleaved(16 * std::size_t(vertexCount));
+    std::vector<double> xs(vertexCount), ys(vertexCount);
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        xs[i] = xDistribution(generator);
+        ys[i] = yDistribution(generator);
+        std::memcpy(&interleaved[16 * i], &xs[i], 8);
+        std::memcpy(&interleaved[16 * i + 8], &ys[i], 8);
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+        std::reverse(&interleaved[16 * i], &interleaved[16 * i + 8]);
+        std::reverse(&interleaved[16 * i + 8], &interleaved[16 * i + 16]);
+#endif
+    }
+    Dataset::PointSpan points(interleaved.data(), vertexCount);
+
+    std::vector<QPoint> scalarPoints(vertexCount), interleavedPoints(vertexCount), splitPoints(vertexCount);
+
+    auto verticesPerSecond = [vertexCount, passCount](qint64 nanoseconds)
+    { return double(vertexCount) * passCount / (nanoseconds * 1e-9) / 1e6; };
+
+    QElapsedTimer timer;
+
+    timer.start();
+    for (int pass = 0; pass < passCount; ++pass)
+        for (int i = 0; i < vertexCount; ++i)
+            scalarPoints[i] = assistant.computePointOnDisplay(points, i).toQPoint();
+    double scalarRate = verticesPerSecond(timer.nsecsElapsed());
+
+    timer.restart();
+    for (int pass = 0; pass < passCount; ++pass)
+        assistant.computePointsOnDisplay(points, interleavedPoints.data());
+    double interleavedRate = verticesPerSecond(timer.nsecsElapsed());
+
+    timer.restart();
+    for (int pass = 0; pass < passCount; ++pass)
+        assistant.computePointsOnDisplay(xs.data(), ys.data(), vertexCount, splitPoints.data());
+    double splitRate = verticesPerSecond(timer.nsecsElapsed());
+
+    int mismatchCount = 0;
+    for (int i = 0; i < vertexCount; ++i)
+        if (interleavedPoints[i] != scalarPoints[i] || splitPoints[i] != scalarPoints[i])
+            ++mismatchCount;
+
+    return QString("%1 vertices x %2 passes\n"
+                   "    Per vertex:         %3 M vertices/s\n"
+                   "    Batch, interleaved: %4 M vertices/s\n"
+                   "    Batch, split x/y:   %5 M vertices/s\n"
+                   "    Results differing from the per-vertex path: %6\n")
+            .arg(vertexCount).arg(passCount)
+            .arg(scalarRate, 0, 'f', 1).arg(interleavedRate, 0, 'f', 1).arg(splitRate, 0, 'f', 1)
+            .arg(mismatchCount);
+}
+
+QString Benchmark::tileRasterization(DataManagement::ShapeDoc const& shapeDoc, Graphics::GraphicAssistant const& assistant,
+                                     QSize const& viewSize, int passCount)
+{
+    WorkStealingPool pool;
+
+    std::vector<int> threadCounts;
+    for (int threadCount = 1; threadCount < pool.threadCount(); threadCount *= 2)
+        threadCounts.push_back(threadCount);
+    threadCounts.push_back(pool.threadCount());
+
+    QString report = QString("%1 x %2 view, best of %3 passes\n")
+            .arg(viewSize.width()).arg(viewSize.height()).arg(passCount);
+
+    QImage frame(viewSize, QImage::Format_ARGB32_Premultiplied);
+    double baseTime = 0;
+
+    for (auto threadCount : threadCounts)
+    {
+        double bestTime = 0;
+        Graphics::DrawStats stats;
+
+        for (int pass = 0; pass < passCount; ++pass)
+        {
+            // A fresh cache each pass, so every tile is rasterized.
+            Graphics::TileCache tileCache(&pool);
+            tileCache.setWorkerLimit(threadCount);
+
+            frame.fill(Qt::white);
+            QPainter painter(&frame);
+
+            QElapsedTimer timer;
+            timer.start();
+            stats = tileCache.draw(painter, shapeDoc, assistant, frame.rect());
+            double time = timer.nsecsElapsed() * 1e-6;
+
+            if (pass == 0 || time < bestTime)
+                bestTime = time;
+        }
+
+        if (threadCount == 1)
+            baseTime = bestTime;
+
+        report += QString("    %1 threads: %2 ms, %3 tiles, speedup %4\n")
+                .arg(threadCount, 2).arg(bestTime, 0, 'f', 1).arg(stats.tilesRendered)
+                .arg(baseTime / bestTime, 0, 'f', 2);
+    }
+
+    return report;
+}
+
+QString Benchmark::attributeScan(DataManagement::ShapeDoc const& shapeDoc)
+{
+    static int const ChunkSize = 4096; // Records parsed per column read.
+
+    QString report;
+
+    for (auto const& layer : shapeDoc.layers())
+    {
+        auto const& dataset = layer->dataset();
+        report += QString("%1: ").arg(QString::fromStdString(dataset->name()));
+
+        DBFHandle streamed = DBFOpen(dataset->path().c_str(), "rb");
+        DBFHandle mapped = DBFOpen(dataset->path().c_str(), "rbm");
+        if (!streamed || !mapped)
+        {
+            report += "no readable .dbf\n";
+            if (streamed)
+                DBFClose(streamed);
+            if (mapped)
+                DBFClose(mapped);
+            continue;
+        }
+
+        int const recordCount = DBFGetRecordCount(streamed);
+        std::vector<int> fields;
+        double megabytes = 0;
+        for (int field = 0; field < DBFGetFieldCount(streamed); ++field)
+        {
+            int width;
+            DBFFieldType type = DBFGetFieldInfo(streamed, field, nullptr, &width, nullptr);
+            if (type == FTInteger || type == FTDouble)
+            {
+                fields.push_back(field);
+                megabytes += double(width) * recordCount / 1048576.0;
+            }
+        }
+
+        std::vector<double> expected(std::size_t(recordCount) * fields.size());
+        std::vector<double> values(ChunkSize);
+        std::vector<unsigned char> isNull(ChunkSize);
+        int mismatchCount = 0;
+
+        QElapsedTimer timer;
+        timer.start();
+        for (std::size_t i = 0; i < fields.size(); ++i)
+            for (int record = 0; record < recordCount; ++record)
+                expected[i * recordCount + record] = DBFReadDoubleAttribute(streamed, record, fields[i]);
+        double streamedTime = timer.nsecsElapsed() * 1e-9;
+
+        timer.restart();
+        for (std::size_t i = 0; i < fields.size(); ++i)
+            for (int first = 0; first < recordCount; first += ChunkSize)
+            {
+                int count = DBFReadDoubleColumn(mapped, fields[i], first, ChunkSize, values.data(), isNull.data());
+                for (int record = 0; record < count; ++record)
+                    if (values[record] != expected[i * recordCount + first + record])
+                        ++mismatchCount;
+            }
+        double mappedTime = timer.nsecsElapsed() * 1e-9;
+
+        report += QString("%1 records, %2 numeric fields, %3\n")
+                .arg(recordCount).arg(fields.size()).arg(mapped->bMapped ? "mapped" : "not mapped, read through stdio");
+        report += QString("    By value: %1 MB/s\n    By column: %2 MB/s, speedup %3, %4 values differ\n")
+                .arg(megabytes / streamedTime, 0, 'f', 1).arg(megabytes / mappedTime, 0, 'f', 1)
+                .arg(streamedTime / mappedTime, 0, 'f', 2).arg(mismatchCount);
+
+        DBFClose(streamed);
+        DBFClose(mapped);
+    }
+
+    return report;
+}
+
+QString Benchmark::memoryUsage(DataManagement::ShapeDoc const& shapeDoc)
+{
+    auto megabytes = [](std::size_t bytes) { return QString::number(bytes / 1048576.0, 'f', 1) + " MB"; };
+
+    QString report;
+    std::size_t total = 0;
+
+    for (auto const& layer : shapeDoc.layers())
+    {
+        auto const& dataset = layer->dataset();
+        total += dataset->memoryUsage();
+
+        report += QString("%1: %2\n").arg(QString::fromStdString(dataset->name())).arg(megabytes(dataset->memoryUsage()));
+        if (dataset->isResident())
+            report += QString("    Resident geometry: %1, %2 vertices, largest rounding error %3\n")
+                    .arg(megabytes(dataset->residentGeometry().memoryUsage()))
+                    .arg(dataset->residentGeometry().vertexCount())
+                    .arg(dataset->residentGeometry().maxError(), 0, 'g', 3);
+        else
+            report += "    Resident geometry: not resident\n";
+
+        // Only the columns styling or filtering asked for so far.
+        report += QString("    Attribute columns: %1\n").arg(megabytes(dataset->attributesMemoryUsage()));
+    }
+
+    // Datasets no layer shows any more, kept open for a later open of the same file.
+    Dataset::DatasetRegistry const& registry = Dataset::DatasetRegistry::instance();
+    report += QString("Total: %1\n").arg(megabytes(total));
+    report += QString("Closed layers kept open: %1 of the %2 budget, %3 datasets open in all\n")
+            .arg(megabytes(registry.unreferencedMemoryUsage()))
+            .arg(megabytes(registry.budget()))
+            .arg(registry.datasetCount());
+
+    return report;
+}
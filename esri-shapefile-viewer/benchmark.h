@@ -0,0 +1,39 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QSize>
+#include <QString>
+#include "nsdef.h"
+#include "support.h"
+
+// Measurements run from the Tools menu against the layers currently open,
+// the report is plain text meant for a message box.
+namespace cl
+{
+namespace Benchmark
+{
+// Query every layer with windows the size of the given one at random places
+// inside the layer, once through each spatial index, and compare the
+// candidates returned and the time per query.
+QString spatialIndex(DataManagement::ShapeDoc const& shapeDoc, Rect<double> const& window, int queryCount = 500);
+
+// Transform random vertices inside the current view one at a time and through
+// the batch kernels, report vertices per second and any result that differs.
+QString transformKernel(Graphics::GraphicAssistant const& assistant, int vertexCount = 1 << 20, int passCount = 10);
+
+// Rasterize every tile of the current view into an empty cache on 1, 2, 4 ... up
+// to all hardware threads, report the best time of each and the speedup over one thread.
+QString tileRasterization(DataManagement::ShapeDoc const& shapeDoc, Graphics::GraphicAssistant const& assistant,
+                          QSize const& viewSize, int passCount = 3);
+
+// Read every numeric field of every layer's .dbf once a value at a time through
+// stdio and once a column at a time from the mapped file, report the bytes per
+// second of each and any value that differs.
+QString attributeScan(DataManagement::ShapeDoc const& shapeDoc);
+
+// What every layer holds in memory, in total and by structure.
+QString memoryUsage(DataManagement::ShapeDoc const& shapeDoc);
+}
+}
+
+#endif // BENCHMARK_H
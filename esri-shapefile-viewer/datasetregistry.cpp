@@ -0,0 +1,146 @@
+#include "datasetregistry.h"
+#include <QDateTime>
+#include <QFileInfo>
+#include <algorithm>
+#include <iterator>
+
+using namespace cl;
+
+std::unique_ptr<Dataset::DatasetRegistry> Dataset::DatasetRegistry::_instance = nullptr;
+
+Dataset::DatasetRegistry& Dataset::DatasetRegistry::instance()
+{
+    static std::once_flag created;
+    std::call_once(created, [] { _instance.reset(new DatasetRegistry()); });
+    return *_instance;
+}
+
+// Copies released after this must not call back into the registry.
+Dataset::DatasetRegistry::~DatasetRegistry()
+{
+    for (auto const& entry : _entries)
+        entry.dataset->_registered = false;
+}
+
+// The file as found on disk and the options that decide what is built for it.
+// Whether the quadtree is kept on disk makes no difference once it is built.
+static std::string datasetKey(std::string const& path, Dataset::OpenOptions const& options)
+{
+    QFileInfo fileInfo(QString::fromStdString(path));
+    QString canonicalPath = fileInfo.canonicalFilePath();
+    if (canonicalPath.isEmpty())
+        canonicalPath = fileInfo.absoluteFilePath();
+
+    return canonicalPath.toStdString()
+            + "|" + std::to_string(fileInfo.size())
+            + "|" + std::to_string(fileInfo.lastModified().toMSecsSinceEpoch())
+            + "|" + std::to_string(int(options.accessMode))
+            + "|" + std::to_string(int(options.indexType))
+            + "|" + std::to_string(int(options.resident));
+}
+
+Dataset::ShapeDatasetShared Dataset::DatasetRegistry::open(std::string const& path, OpenOptions const& options)
+{
+    std::string key = datasetKey(path, options);
+
+    auto find = [this, &key]() -> ShapeDatasetShared
+    {
+        for (auto entry = _entries.begin(); entry != _entries.end(); ++entry)
+            if (entry->key == key)
+            {
+                _entries.splice(_entries.begin(), _entries, entry);
+                return entry->dataset;
+            }
+        return ShapeDatasetShared();
+    };
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    ShapeDatasetShared dataset = find();
+    if (dataset != nullptr)
+        return dataset;
+    lock.unlock();
+
+    // Open without the lock, building the index may take long. Should another
+    // thread have opened the same file meanwhile, its dataset wins.
+    ShapeDatasetShared opened(path, options);
+    if (opened->handle() == nullptr)
+        return opened;
+
+    lock.lock();
+    dataset = find();
+    if (dataset != nullptr)
+        return dataset;
+
+    opened->_registered = true;
+    _entries.push_front({key, opened});
+    trim(_budgetBytes);
+
+    return opened;
+}
+
+std::size_t Dataset::DatasetRegistry::budget() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _budgetBytes;
+}
+
+void Dataset::DatasetRegistry::setBudget(std::size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _budgetBytes = budgetBytes;
+    trim(_budgetBytes);
+}
+
+void Dataset::DatasetRegistry::trim()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    trim(_budgetBytes);
+}
+
+void Dataset::DatasetRegistry::clearUnreferenced()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    trim(0);
+}
+
+// Only the registry holds a dataset of use count one, no other copy can appear
+// but through open(), which takes the lock first. No copy dropped under the lock
+// leaves the registry alone with a dataset, the release would wait on the lock.
+void Dataset::DatasetRegistry::trim(std::size_t budgetBytes)
+{
+    std::size_t usage = 0;
+    for (auto const& entry : _entries)
+        if (entry.dataset.useCount() == 1)
+            usage += entry.dataset->memoryUsage();
+
+    for (auto entry = _entries.rbegin(); entry != _entries.rend() && usage > budgetBytes; )
+    {
+        if (entry->dataset.useCount() != 1)
+        {
+            ++entry;
+            continue;
+        }
+
+        // A pyramid built since the sum above only adds to the usage.
+        usage -= std::min(usage, entry->dataset->memoryUsage());
+        entry = std::list<Entry>::reverse_iterator(_entries.erase(std::next(entry).base()));
+    }
+}
+
+int Dataset::DatasetRegistry::datasetCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return int(_entries.size());
+}
+
+std::size_t Dataset::DatasetRegistry::unreferencedMemoryUsage() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::size_t usage = 0;
+    for (auto const& entry : _entries)
+        if (entry.dataset.useCount() == 1)
+            usage += entry.dataset->memoryUsage();
+
+    return usage;
+}
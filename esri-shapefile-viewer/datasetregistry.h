@@ -0,0 +1,55 @@
+#ifndef DATASETREGISTRY_H
+#define DATASETREGISTRY_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <cstddef>
+#include "nsdef.h"
+#include "shapedata.h"
+
+// Every dataset open in the process, so that opening a file again, as another
+// layer or from another view, shares the handle and indexes already built.
+// A dataset is known by its canonical path, size and modification time, and by
+// the options that change what is built for it. Datasets no layer refers to any
+// more are kept for a later open, the least recently used are closed once they
+// take more than the budget. The budget is checked on every open and whenever
+// the last copy outside the registry is released.
+class cl::Dataset::DatasetRegistry
+{
+public:
+    static DatasetRegistry& instance();
+    ~DatasetRegistry();
+
+    // The dataset already open for the file, or a newly opened one.
+    // Safe to call from several threads.
+    ShapeDatasetShared open(std::string const& path, OpenOptions const& options);
+
+    std::size_t budget() const;
+    void setBudget(std::size_t budgetBytes);
+
+    // Close the unreferenced datasets over the budget, or all of them.
+    void trim();
+    void clearUnreferenced();
+
+    int datasetCount() const;
+    std::size_t unreferencedMemoryUsage() const;
+
+private:
+    struct Entry
+    {
+        std::string key;
+        ShapeDatasetShared dataset;
+    };
+
+    DatasetRegistry() = default;
+    void trim(std::size_t budgetBytes);
+
+    mutable std::mutex _mutex;
+    std::list<Entry> _entries; // The most recently opened first.
+    std::size_t _budgetBytes = std::size_t(256) << 20;
+
+    static std::unique_ptr<DatasetRegistry> _instance;
+};
+
+#endif // DATASETREGISTRY_H
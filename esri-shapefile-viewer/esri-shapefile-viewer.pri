@@ -0,0 +1,62 @@
+# Everything but main(), shared by the application and the tests.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/../shapelib/dbfopen.cpp \
+    $$PWD/../shapelib/shpopen.cpp \
+    $$PWD/../shapelib/shptree.cpp \
+    $$PWD/sidebar.cpp \
+    $$PWD/viewform.cpp \
+    $$PWD/shapemanager.cpp \
+    $$PWD/shapedata.cpp \
+    $$PWD/map.cpp \
+    $$PWD/mainwindow.cpp \
+    $$PWD/mapwindow.cpp \
+    $$PWD/packedrtree.cpp \
+    $$PWD/benchmark.cpp \
+    $$PWD/renderthread.cpp \
+    $$PWD/tilecache.cpp \
+    $$PWD/workstealingpool.cpp \
+    $$PWD/lodpyramid.cpp \
+    $$PWD/geometrystore.cpp \
+    $$PWD/layerloader.cpp \
+    $$PWD/datasetregistry.cpp \
+    $$PWD/attributetablemodel.cpp \
+    $$PWD/attributetable.cpp \
+    $$PWD/attributecolumns.cpp \
+    $$PWD/thematicstyle.cpp \
+    $$PWD/attributefilter.cpp
+
+HEADERS  += \
+    $$PWD/../shapelib/shapefil.h \
+    $$PWD/sidebar.h \
+    $$PWD/viewform.h \
+    $$PWD/shapedata.h \
+    $$PWD/shapemanager.h \
+    $$PWD/nsdef.h \
+    $$PWD/support.h \
+    $$PWD/map.h \
+    $$PWD/mainwindow.h \
+    $$PWD/mapwindow.h \
+    $$PWD/packedrtree.h \
+    $$PWD/benchmark.h \
+    $$PWD/renderthread.h \
+    $$PWD/tilecache.h \
+    $$PWD/workstealingpool.h \
+    $$PWD/lodpyramid.h \
+    $$PWD/geometrystore.h \
+    $$PWD/layerloader.h \
+    $$PWD/datasetregistry.h \
+    $$PWD/attributetablemodel.h \
+    $$PWD/attributetable.h \
+    $$PWD/attributecolumns.h \
+    $$PWD/thematicstyle.h \
+    $$PWD/attributefilter.h
+
+FORMS    += \
+    $$PWD/mainwindow.ui \
+    $$PWD/viewform.ui \
+    $$PWD/sidebar.ui \
+    $$PWD/mapwindow.ui \
+    $$PWD/attributetable.ui
@@ -23,32 +23,6 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 
-SOURCES +=\
-    ../shapelib/dbfopen.cpp \
-    ../shapelib/shpopen.cpp \
-    ../shapelib/shptree.cpp \
-    main.cpp \
-    sidebar.cpp \
-    viewform.cpp \
-    shapemanager.cpp \
-    shapedata.cpp \
-    map.cpp \
-    mainwindow.cpp \
-    mapwindow.cpp
-
-HEADERS  += \
-    ../shapelib/shapefil.h \
-    sidebar.h \
-    viewform.h \
-    shapedata.h \
-    shapemanager.h \
-    nsdef.h \
-    support.h \
-    map.h \
-    mainwindow.h \
-    mapwindow.h
-
-FORMS    += mainwindow.ui \
-    viewform.ui \
-    sidebar.ui \
-    mapwindow.ui
+include(esri-shapefile-viewer.pri)
+
+SOURCES += main.cpp
@@ -0,0 +1,142 @@
+#include "geometrystore.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+#include "shapedata.h"
+
+using namespace cl;
+
+int const Dataset::GeometryStore::GridBits;
+
+Dataset::GeometryStore::GeometryStore(Rect<double> const& bounds)
+    : _gridMin(bounds.xMin(), bounds.yMin()), _cellSize(bounds.range() / double(1 << GridBits)) {}
+
+Dataset::GeometryStore::GeometryStore(SHPHandle shpHandle)
+    : GeometryStore(Rect<double>(shpHandle->adBoundsMin, shpHandle->adBoundsMax))
+{
+    // Size everything up front from the record lengths, every vertex takes 16 bytes
+    // in the file and every part 4, so the arrays are filled without reallocating.
+    std::size_t vertexEstimate = 0;
+    for (int recordId = 0; recordId < shpHandle->nRecords; ++recordId)
+        vertexEstimate += std::size_t(std::max(0, shpHandle->panRecSize[recordId])) / 16;
+
+    _recordParts.reserve(shpHandle->nRecords + 1);
+    _recordCells.reserve(shpHandle->nRecords);
+    _xs.reserve(vertexEstimate);
+    _ys.reserve(vertexEstimate);
+
+    for (int recordId = 0; recordId < shpHandle->nRecords; ++recordId)
+    {
+        beginRecord();
+
+        ShapeRecordView record(shpHandle, recordId);
+        for (int partIndex = 0; partIndex < record.partCount(); ++partIndex)
+        {
+            PointSpan points = record.partPoints(partIndex);
+
+            beginPart();
+            for (int i = 0; i < points.size(); ++i)
+                addVertex(points.x(i), points.y(i));
+        }
+
+        // A point or multipoint record has no part table, its vertices make one part.
+        if (record.partCount() == 0 && record.vertexCount() > 0)
+        {
+            PointSpan points = record.points();
+
+            beginPart();
+            for (int i = 0; i < points.size(); ++i)
+                addVertex(points.x(i), points.y(i));
+        }
+    }
+
+    finish();
+}
+
+void Dataset::GeometryStore::beginRecord()
+{
+    if (!_recordParts.empty())
+        storePendingRecord();
+
+    _recordParts.push_back(int(_partStarts.size()));
+}
+
+void Dataset::GeometryStore::finish()
+{
+    if (!_recordParts.empty())
+        storePendingRecord();
+
+    _recordParts.push_back(int(_partStarts.size()));
+    _partStarts.push_back(int(_xs.size()));
+
+    _recordParts.shrink_to_fit();
+    _partStarts.shrink_to_fit();
+    _recordCells.shrink_to_fit();
+    _xs.shrink_to_fit();
+    _ys.shrink_to_fit();
+
+    _pendingXs = std::vector<double>();
+    _pendingYs = std::vector<double>();
+}
+
+double Dataset::GeometryStore::errorBound(double value, double origin)
+{
+    return std::ldexp(std::abs(value - origin), -24) + std::ldexp(std::abs(value), -50);
+}
+
+Pair<double> Dataset::GeometryStore::recordOrigin(int recordId) const
+{
+    unsigned int cell = _recordCells[recordId];
+    unsigned int column = cell & ((1u << GridBits) - 1), row = cell >> GridBits;
+
+    return Pair<double>(_gridMin.x() + (column + 0.5) * _cellSize.x(), _gridMin.y() + (row + 0.5) * _cellSize.y());
+}
+
+// Store the vertices added since the last beginRecord() as offsets from the center of their cell.
+void Dataset::GeometryStore::storePendingRecord()
+{
+    auto cellOf = [](std::vector<double> const& pending, double gridMin, double cellSize) -> unsigned int
+    {
+        if (pending.empty() || !(cellSize > 0))
+            return 0;
+
+        auto range = std::minmax_element(pending.begin(), pending.end());
+        double center = *range.first + (*range.second - *range.first) / 2;
+        double cell = std::floor((center - gridMin) / cellSize);
+
+        // Vertices outside the header's bounds only make for longer offsets.
+        return (unsigned int)(std::max(0.0, std::min(cell, double((1 << GridBits) - 1))));
+    };
+
+    unsigned int column = cellOf(_pendingXs, _gridMin.x(), _cellSize.x());
+    unsigned int row = cellOf(_pendingYs, _gridMin.y(), _cellSize.y());
+    _recordCells.push_back(row << GridBits | column);
+
+    Pair<double> origin = recordOrigin(int(_recordCells.size()) - 1);
+
+    auto storeAxis = [this](std::vector<double> const& pending, double origin, std::vector<float>& offsets)
+    {
+        for (double value : pending)
+        {
+            float offset = float(value - origin);
+            offsets.push_back(offset);
+
+            double error = std::abs(origin + double(offset) - value);
+            Q_ASSERT(error <= errorBound(value, origin));
+            _maxError = std::max(_maxError, error);
+        }
+    };
+
+    storeAxis(_pendingXs, origin.x(), _xs);
+    storeAxis(_pendingYs, origin.y(), _ys);
+
+    _pendingXs.clear();
+    _pendingYs.clear();
+}
+
+std::size_t Dataset::GeometryStore::memoryUsage() const
+{
+    return (_recordParts.capacity() + _partStarts.capacity()) * sizeof(int)
+            + _recordCells.capacity() * sizeof(unsigned int)
+            + (_xs.capacity() + _ys.capacity()) * sizeof(float);
+}
@@ -0,0 +1,76 @@
+#ifndef GEOMETRYSTORE_H
+#define GEOMETRYSTORE_H
+
+#include <vector>
+#include <cstddef>
+#include "../shapelib/shapefil.h"
+#include "nsdef.h"
+#include "support.h"
+
+// The decoded vertices of a whole dataset as a structure of arrays: one array
+// of x, one of y, the first vertex of every part and the first part of every
+// record. The parts of a record and the vertices of a part are consecutive,
+// so drawing a part hands two plain arrays to the transform.
+//
+// Vertices are kept as float offsets, half the size of doubles, from an origin
+// per record: the center of the cell its bounds center falls in, on a grid of
+// 65536 x 65536 cells over the dataset. A float keeps 24 significant bits, so
+// no vertex moves by more than its offset times 2^-24, far under a pixel unless
+// the record spans millions of pixels. The origin takes only its cell's number.
+class cl::Dataset::GeometryStore
+{
+public:
+    GeometryStore() = default;
+
+    // An empty store for geometry within bounds, to be filled as below.
+    explicit GeometryStore(Rect<double> const& bounds);
+
+    // Decode every record of the dataset.
+    explicit GeometryStore(SHPHandle shpHandle);
+
+    // Fill a store record by record: beginRecord() for every record in order,
+    // beginPart() for each of its parts, addVertex() for each vertex, then finish().
+    // A record is converted to offsets once the next one begins.
+    void beginRecord();
+    void beginPart() { _partStarts.push_back(int(_xs.size() + _pendingXs.size())); }
+    void addVertex(double x, double y) { _pendingXs.push_back(x); _pendingYs.push_back(y); }
+    void finish();
+
+    int recordCount() const { return _recordParts.empty() ? 0 : int(_recordParts.size()) - 1; }
+    int vertexCount() const { return int(_xs.size()); }
+    std::size_t memoryUsage() const;
+
+    // The largest distance, per axis, between a stored vertex and the one it was built from.
+    double maxError() const { return _maxError; }
+
+    // How far a coordinate may move when stored as an offset from origin: the offset's
+    // rounding to 24 bits, plus a few double roundings of the value itself.
+    static double errorBound(double value, double origin);
+
+    // The parts of record recordId are [firstPart(recordId), firstPart(recordId + 1)).
+    // The vertices of a part are partXs/partYs relative to its record's origin.
+    int firstPart(int recordId) const { return _recordParts[recordId]; }
+    Pair<double> recordOrigin(int recordId) const;
+    int partSize(int partIndex) const { return _partStarts[partIndex + 1] - _partStarts[partIndex]; }
+    float const* partXs(int partIndex) const { return _xs.data() + _partStarts[partIndex]; }
+    float const* partYs(int partIndex) const { return _ys.data() + _partStarts[partIndex]; }
+
+private:
+    static int const GridBits = 16;
+
+    void storePendingRecord();
+
+    Pair<double> _gridMin = Pair<double>(0, 0);
+    Pair<double> _cellSize = Pair<double>(0, 0);
+
+    std::vector<int> _recordParts;
+    std::vector<int> _partStarts;
+    std::vector<unsigned int> _recordCells; // The row in the high bits, the column in the low ones.
+    std::vector<float> _xs, _ys;
+    double _maxError = 0;
+
+    // The record being filled, in full precision until its origin is known.
+    std::vector<double> _pendingXs, _pendingYs;
+};
+
+#endif // GEOMETRYSTORE_H
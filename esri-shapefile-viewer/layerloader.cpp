@@ -0,0 +1,129 @@
+#include "layerloader.h"
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+#include "shapedata.h"
+
+using namespace cl;
+
+// Opens one file on a pool thread and hands the layer back to the loader.
+class LayerLoader::Job : public QRunnable
+{
+public:
+    Job(LayerLoader& loader, unsigned long batch, QString const& path, Dataset::OpenOptions const& options)
+        : _loader(loader), _batch(batch), _path(path), _options(options) {}
+
+    virtual void run() override
+    {
+        std::shared_ptr<Graphics::Shape> layer =
+                DataManagement::ShapeFactoryEsri::instance().createShape(_path.toStdString(), _options);
+
+        QMutexLocker locker(&_loader._mutex);
+        _loader._opened.push_back({_batch, _path, layer});
+        locker.unlock();
+
+        QMetaObject::invokeMethod(&_loader, "collectOpenedLayers", Qt::QueuedConnection);
+    }
+
+private:
+    LayerLoader& _loader;
+    unsigned long _batch;
+    QString _path;
+    Dataset::OpenOptions _options;
+};
+
+LayerLoader::LayerLoader(QObject* parent)
+    : QObject(parent), _batch(0), _finishedCount(0), _totalCount(0) {}
+
+LayerLoader::~LayerLoader()
+{
+    // The jobs still running write into this object.
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+void LayerLoader::load(QStringList const& paths, Dataset::OpenOptions const& options)
+{
+    if (paths.empty())
+        return;
+
+    _totalCount += int(paths.size());
+    emit progressChanged(_finishedCount, _totalCount);
+
+    // The files opened at once scan on a share of the cores each, rather than
+    // each starting a thread per core.
+    int openingCount = std::max(1, std::min(_totalCount - _finishedCount, _pool.maxThreadCount()));
+    int scanThreadShare = std::max(1, QThread::idealThreadCount() / openingCount);
+
+    Dataset::OpenOptions jobOptions = options;
+    jobOptions.maxScanThreads = options.maxScanThreads > 0 ? std::min(options.maxScanThreads, scanThreadShare)
+                                                           : scanThreadShare;
+
+    for (auto const& path : paths)
+        _pool.start(new Job(*this, _batch, path, jobOptions));
+}
+
+void LayerLoader::cancel()
+{
+    if (!isLoading())
+        return;
+
+    _pool.clear();
+    finishBatch();
+}
+
+void LayerLoader::collectOpenedLayers()
+{
+    using namespace DataManagement;
+
+    std::vector<Opened> opened;
+    QMutexLocker locker(&_mutex);
+    opened.swap(_opened);
+    locker.unlock();
+
+    int collectedCount = 0;
+    for (auto const& item : opened)
+    {
+        // Left over from a cancelled batch.
+        if (item.batch != _batch)
+            continue;
+
+        ++collectedCount;
+        ++_finishedCount;
+
+        if (!item.layer)
+        {
+            _failedPaths << item.path;
+            continue;
+        }
+
+        bool notInitialized = ShapeView::instance().isEmpty();
+
+        ShapeView::instance().addLayer(item.layer);
+
+        if (notInitialized)
+            ShapeView::instance().zoomToAll();
+    }
+
+    if (collectedCount == 0)
+        return;
+
+    emit progressChanged(_finishedCount, _totalCount);
+
+    if (!isLoading())
+        finishBatch();
+}
+
+void LayerLoader::finishBatch()
+{
+    QStringList failedPaths = _failedPaths;
+
+    ++_batch;
+    _finishedCount = 0;
+    _totalCount = 0;
+    _failedPaths.clear();
+
+    emit loadingFinished(failedPaths);
+}
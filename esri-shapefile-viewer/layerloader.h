@@ -0,0 +1,67 @@
+#ifndef LAYERLOADER_H
+#define LAYERLOADER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "shapemanager.h"
+
+// Opens datasets on a pool of threads, one job per file, so the GUI keeps running
+// while the indexes are built. Each layer joins the view on the GUI thread as soon
+// as its file is open, in the order the jobs finish rather than the order given.
+class LayerLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LayerLoader(QObject* parent = nullptr);
+    ~LayerLoader();
+
+    // Queue more files, joining a batch still in progress.
+    void load(QStringList const& paths, cl::Dataset::OpenOptions const& options);
+    bool isLoading() const { return _finishedCount < _totalCount; }
+
+public slots:
+    // Files not started yet are skipped. Those being opened cannot be interrupted,
+    // their layers are dropped once they are done.
+    void cancel();
+
+signals:
+    void progressChanged(int finishedCount, int totalCount);
+
+    // The whole batch is done or was cancelled, with the files that could not be opened.
+    void loadingFinished(QStringList const& failedPaths);
+
+private slots:
+    // Called on the GUI thread by every job that finishes.
+    void collectOpenedLayers();
+
+private:
+    class Job;
+
+    void finishBatch();
+
+    QThreadPool _pool;
+
+    // Filled by the jobs, drained on the GUI thread.
+    QMutex _mutex;
+    struct Opened
+    {
+        unsigned long batch;
+        QString path;
+        std::shared_ptr<cl::Graphics::Shape> layer;
+    };
+    std::vector<Opened> _opened;
+
+    // Only touched on the GUI thread.
+    unsigned long _batch;
+    int _finishedCount;
+    int _totalCount;
+    QStringList _failedPaths;
+};
+
+#endif // LAYERLOADER_H
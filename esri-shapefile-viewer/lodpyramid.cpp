@@ -0,0 +1,220 @@
+#include "lodpyramid.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include "shapedata.h"
+
+using namespace cl;
+
+int const Dataset::LodPyramid::LevelCount;
+
+// The squared distance from (x, y) to the segment from (x0, y0) to (x1, y1).
+static double segmentDistanceSquared(double x, double y, double x0, double y0, double x1, double y1)
+{
+    double dx = x1 - x0, dy = y1 - y0;
+    double lengthSquared = dx * dx + dy * dy;
+
+    double t = lengthSquared > 0 ? ((x - x0) * dx + (y - y0) * dy) / lengthSquared : 0;
+    t = std::max(0.0, std::min(1.0, t));
+
+    double ex = x - (x0 + t * dx), ey = y - (y0 + t * dy);
+    return ex * ex + ey * ey;
+}
+
+// Douglas-Peucker down to a tolerance of zero, recording for every vertex the
+// largest tolerance at which it is still kept. A split deeper down can never
+// outlive the splits above it, hence the minimum with the parent's tolerance.
+// The endpoints are always kept.
+static void computeSignificance(double const* xs, double const* ys, int count, std::vector<double>& significance)
+{
+    double const infinity = std::numeric_limits<double>::infinity();
+
+    significance.assign(count, 0.0);
+    significance[0] = significance[count - 1] = infinity;
+
+    struct Span
+    {
+        int first, last;
+        double tolerance;
+    };
+    std::vector<Span> stack;
+    stack.push_back({0, count - 1, infinity});
+
+    while (!stack.empty())
+    {
+        Span span = stack.back();
+        stack.pop_back();
+
+        if (span.last - span.first < 2)
+            continue;
+
+        int farthest = span.first + 1;
+        double farthestDistance = -1;
+        for (int i = span.first + 1; i < span.last; ++i)
+        {
+            double distance = segmentDistanceSquared(xs[i], ys[i], xs[span.first], ys[span.first],
+                                                     xs[span.last], ys[span.last]);
+            if (distance > farthestDistance)
+            {
+                farthest = i;
+                farthestDistance = distance;
+            }
+        }
+
+        double tolerance = std::min(std::sqrt(farthestDistance), span.tolerance);
+        significance[farthest] = tolerance;
+
+        stack.push_back({span.first, farthest, tolerance});
+        stack.push_back({farthest, span.last, tolerance});
+    }
+}
+
+Dataset::LodPyramid::LodPyramid(SHPHandle shpHandle, std::atomic<bool> const* cancelFlag)
+{
+    std::vector<double> xs, ys;
+
+    build(Rect<double>(shpHandle->adBoundsMin, shpHandle->adBoundsMax), shpHandle->nRecords,
+          [&](int recordId, std::function<void(double const*, double const*, int)> const& visit)
+    {
+        ShapeRecordView record(shpHandle, recordId);
+
+        for (int partIndex = 0; partIndex < record.partCount(); ++partIndex)
+        {
+            PointSpan points = record.partPoints(partIndex);
+
+            xs.resize(points.size());
+            ys.resize(points.size());
+            for (int i = 0; i < points.size(); ++i)
+            {
+                xs[i] = points.x(i);
+                ys[i] = points.y(i);
+            }
+
+            visit(xs.data(), ys.data(), points.size());
+        }
+    }, cancelFlag);
+}
+
+Dataset::LodPyramid::LodPyramid(GeometryStore const& source, Rect<double> const& bounds,
+                                std::atomic<bool> const* cancelFlag)
+{
+    std::vector<double> xs, ys;
+
+    build(bounds, source.recordCount(),
+          [&](int recordId, std::function<void(double const*, double const*, int)> const& visit)
+    {
+        Pair<double> origin = source.recordOrigin(recordId);
+
+        for (int partIndex = source.firstPart(recordId); partIndex < source.firstPart(recordId + 1); ++partIndex)
+        {
+            int partSize = source.partSize(partIndex);
+            float const* partXs = source.partXs(partIndex);
+            float const* partYs = source.partYs(partIndex);
+
+            xs.resize(partSize);
+            ys.resize(partSize);
+            for (int i = 0; i < partSize; ++i)
+            {
+                xs[i] = origin.x() + partXs[i];
+                ys[i] = origin.y() + partYs[i];
+            }
+
+            visit(xs.data(), ys.data(), partSize);
+        }
+    }, cancelFlag);
+}
+
+// The finest level is about a pixel at a million pixels across the dataset,
+// the coarsest one about a pixel at a few thousand.
+double Dataset::LodPyramid::levelTolerance(double extent, int levelIndex)
+{
+    return std::ldexp(extent, 2 * levelIndex - 20);
+}
+
+double Dataset::LodPyramid::maxLevelScale(Rect<double> const& bounds)
+{
+    double extent = std::max(bounds.xRange(), bounds.yRange());
+    return extent > 0 ? 0.5 / levelTolerance(extent, 0) : 0.0;
+}
+
+template<typename ForEachPart>
+void Dataset::LodPyramid::build(Rect<double> const& bounds, int recordCount, ForEachPart forEachPart,
+                                std::atomic<bool> const* cancelFlag)
+{
+    double extent = std::max(bounds.xRange(), bounds.yRange());
+    if (!(extent > 0))
+        return;
+
+    std::vector<Level> levels(LevelCount);
+    for (int levelIndex = 0; levelIndex < LevelCount; ++levelIndex)
+    {
+        levels[levelIndex].tolerance = levelTolerance(extent, levelIndex);
+        levels[levelIndex].geometry = GeometryStore(bounds);
+    }
+
+    std::vector<double> significance;
+
+    for (int recordId = 0; recordId < recordCount; ++recordId)
+    {
+        if (cancelFlag && *cancelFlag)
+        {
+            _sourceVertexCount = 0;
+            return;
+        }
+
+        for (auto& level : levels)
+            level.geometry.beginRecord();
+
+        forEachPart(recordId, [&](double const* xs, double const* ys, int count)
+        {
+            if (count == 0)
+                return;
+
+            _sourceVertexCount += count;
+            computeSignificance(xs, ys, count, significance);
+
+            for (auto& level : levels)
+            {
+                level.geometry.beginPart();
+                for (int i = 0; i < count; ++i)
+                    if (significance[i] > level.tolerance)
+                        level.geometry.addVertex(xs[i], ys[i]);
+            }
+        });
+    }
+
+    // A level that saves little over the finer one is not worth its memory. Only
+    // once finished does a level count the vertices of its last record.
+    int finerVertexCount = _sourceVertexCount;
+    for (auto& level : levels)
+    {
+        level.geometry.finish();
+        if (level.geometry.vertexCount() > finerVertexCount / 2)
+            continue;
+
+        finerVertexCount = level.geometry.vertexCount();
+        _levels.push_back(std::move(level));
+    }
+}
+
+std::size_t Dataset::LodPyramid::memoryUsage() const
+{
+    std::size_t usage = 0;
+    for (auto const& level : _levels)
+        usage += level.geometry.memoryUsage();
+
+    return usage;
+}
+
+Dataset::LodPyramid::Level const* Dataset::LodPyramid::selectLevel(float scaleToDisplay) const
+{
+    double halfPixel = 0.5 / scaleToDisplay;
+
+    // The float storage of a level adds its own error on top of the simplification's.
+    for (auto level = _levels.rbegin(); level != _levels.rend(); ++level)
+        if (level->tolerance + level->geometry.maxError() <= halfPixel)
+            return &*level;
+
+    return nullptr;
+}
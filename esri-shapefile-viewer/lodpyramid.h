@@ -0,0 +1,63 @@
+#ifndef LODPYRAMID_H
+#define LODPYRAMID_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include "../shapelib/shapefil.h"
+#include "nsdef.h"
+#include "support.h"
+#include "geometrystore.h"
+
+// Simplified copies of every part of a polyline or polygon dataset, one per level.
+// Each level is the Douglas-Peucker simplification at a tolerance four times the
+// one below, so a view picks the coarsest level whose error stays under half a
+// pixel. Every vertex gets the largest tolerance it survives at in a single pass,
+// and a level keeps exactly the vertices above its own.
+class cl::Dataset::LodPyramid
+{
+public:
+    // One simplified copy of the dataset.
+    struct Level
+    {
+        double tolerance;
+        GeometryStore geometry;
+    };
+
+    static int const LevelCount = 8;
+
+    LodPyramid() = default;
+
+    // Simplify every record of the dataset, read from the file or from its resident
+    // copy. Levels that would not drop at least half the vertices of the next finer
+    // one are not kept. Raising the cancel flag stops the build and leaves it empty.
+    explicit LodPyramid(SHPHandle shpHandle, std::atomic<bool> const* cancelFlag = nullptr);
+    LodPyramid(GeometryStore const& source, Rect<double> const& bounds,
+               std::atomic<bool> const* cancelFlag = nullptr);
+
+    // The largest scale at which a level of a dataset with these bounds could be
+    // selected, closer in the source is always drawn. Known without building anything.
+    static double maxLevelScale(Rect<double> const& bounds);
+
+    bool isEmpty() const { return _levels.empty(); }
+    int levelCount() const { return int(_levels.size()); }
+    int sourceVertexCount() const { return _sourceVertexCount; }
+    std::size_t memoryUsage() const;
+
+    // The coarsest level no further than half a pixel from the source geometry,
+    // nullptr if the source itself should be drawn.
+    Level const* selectLevel(float scaleToDisplay) const;
+
+private:
+    // Build from forEachPart(recordId, visit), which calls visit(xs, ys, count) for every part.
+    template<typename ForEachPart>
+    void build(Rect<double> const& bounds, int recordCount, ForEachPart forEachPart,
+               std::atomic<bool> const* cancelFlag);
+
+    static double levelTolerance(double extent, int levelIndex);
+
+    std::vector<Level> _levels; // From the finest to the coarsest.
+    int _sourceVertexCount = 0;
+};
+
+#endif // LODPYRAMID_H
@@ -4,6 +4,17 @@
 #include <QTime>
 #include <QLabel>
 #include <QListWidget>
+#include <QMessageBox>
+#include <QActionGroup>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QInputDialog>
+#include <QLineEdit>
+#include "benchmark.h"
+#include "shapedata.h"
+#include "thematicstyle.h"
+#include "attributefilter.h"
+#include "datasetregistry.h"
 
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent), ui(new Ui::MainWindow)
@@ -22,22 +33,61 @@ MainWindow::MainWindow(QWidget* parent)
     _sidebar.reset(new Sidebar(this));
     addDockWidget(Qt::LeftDockWidgetArea, _sidebar.get(), Qt::Vertical);
 
+    // Initialize the attribute table, shown once a layer's table is asked for.
+    _attributeTable.reset(new AttributeTable(this));
+    addDockWidget(Qt::BottomDockWidgetArea, _attributeTable.get(), Qt::Horizontal);
+    _attributeTable->hide();
+
     // Initialize the status label.
     _msgLabel.reset(new QLabel());
     statusBar()->setStyleSheet(QString("QStatusBar::item{border: 0px}"));
     statusBar()->addWidget(_msgLabel.get());
 
+    // Initialize the background loader, its progress bar and cancel button stay hidden while idle.
+    _layerLoader.reset(new LayerLoader());
+    _loadProgress.reset(new QProgressBar());
+    _loadProgress->setMaximumWidth(200);
+    _loadProgress->setFormat(tr("Opening %v/%m"));
+    _loadProgress->hide();
+    _cancelLoading.reset(new QPushButton(tr("Cancel")));
+    _cancelLoading->hide();
+    statusBar()->addPermanentWidget(_loadProgress.get());
+    statusBar()->addPermanentWidget(_cancelLoading.get());
+
+    // Only one way of drawing small features can be checked.
+    _smallFeaturesGroup.reset(new QActionGroup(this));
+    _smallFeaturesGroup->addAction(ui->actionSmall_Features_Geometry);
+    _smallFeaturesGroup->addAction(ui->actionSmall_Features_Pixels);
+    _smallFeaturesGroup->addAction(ui->actionSmall_Features_Density);
+
     // Bind the singleton dataset with this form as its observer.
     cl::DataManagement::ShapeView::instance().setObserver(*this);
 
     // Connect the open file signal.
     connect(ui->actionOpen_Dataset, SIGNAL(triggered(bool)), this, SLOT(openDataset()));
+    connect(ui->actionOpen_Dataset_Resident, SIGNAL(triggered(bool)), this, SLOT(openDatasetResident()));
+    connect(_layerLoader.get(), SIGNAL(progressChanged(int,int)), this, SLOT(showLoadingProgress(int,int)));
+    connect(_layerLoader.get(), SIGNAL(loadingFinished(QStringList)), this, SLOT(finishLoading(QStringList)));
+    connect(_cancelLoading.get(), SIGNAL(clicked()), _layerLoader.get(), SLOT(cancel()));
     connect(ui->actionClose_All, SIGNAL(triggered(bool)), this, SLOT(closeAll()));
     connect(ui->actionRemove_Layer, SIGNAL(triggered(bool)), this, SLOT(removeLayer()));
     connect(ui->actionLayer_Up, SIGNAL(triggered(bool)), this, SLOT(layerUp()));
     connect(ui->actionLayer_Down, SIGNAL(triggered(bool)), this, SLOT(layerDown()));
+    connect(ui->actionAttribute_Table, SIGNAL(triggered(bool)), this, SLOT(showAttributeTable()));
+    connect(ui->actionThematic_Style, SIGNAL(triggered(bool)), this, SLOT(styleLayerByAttribute()));
+    connect(ui->actionClear_Thematic_Style, SIGNAL(triggered(bool)), this, SLOT(clearLayerStyle()));
+    connect(ui->actionDefinition_Query, SIGNAL(triggered(bool)), this, SLOT(setDefinitionQuery()));
     connect(ui->actionFull_Elements, SIGNAL(triggered(bool)), this, SLOT(createMapFullElements()));
     connect(ui->actionNo_Grid_Line, SIGNAL(triggered(bool)), this, SLOT(createMapNoGridLine()));
+    connect(ui->actionSmall_Features_Geometry, SIGNAL(triggered(bool)), this, SLOT(drawSmallFeaturesAsGeometry()));
+    connect(ui->actionSmall_Features_Pixels, SIGNAL(triggered(bool)), this, SLOT(drawSmallFeaturesAsPixels()));
+    connect(ui->actionSmall_Features_Density, SIGNAL(triggered(bool)), this, SLOT(drawSmallFeaturesAsDensity()));
+    connect(ui->actionBenchmark_Spatial_Index, SIGNAL(triggered(bool)), this, SLOT(benchmarkSpatialIndex()));
+    connect(ui->actionBenchmark_Transform, SIGNAL(triggered(bool)), this, SLOT(benchmarkTransform()));
+    connect(ui->actionBenchmark_Tile_Rasterization, SIGNAL(triggered(bool)), this, SLOT(benchmarkTileRasterization()));
+    connect(ui->actionBenchmark_Attribute_Scan, SIGNAL(triggered(bool)), this, SLOT(benchmarkAttributeScan()));
+    connect(ui->actionLayer_Memory_Usage, SIGNAL(triggered(bool)), this, SLOT(reportMemoryUsage()));
+    connect(ui->actionClosed_Layer_Budget, SIGNAL(triggered(bool)), this, SLOT(setClosedLayerBudget()));
     // If the slot function name is wrong,
     // without any error prompts the connection will not work.
 
@@ -62,8 +112,18 @@ void MainWindow::setLabel(QString const& msg)
 
 void MainWindow::openDataset()
 {
-    using namespace cl::DataManagement;
+    openDatasets(cl::Dataset::OpenOptions());
+}
+
+void MainWindow::openDatasetResident()
+{
+    cl::Dataset::OpenOptions options;
+    options.resident = true;
+    openDatasets(options);
+}
 
+void MainWindow::openDatasets(cl::Dataset::OpenOptions const& options)
+{
     QFileDialog dialog(this, tr("Open ESRI Shape File:"), "", tr("*.shp"));
     dialog.setFileMode(QFileDialog::ExistingFiles); // Accept multiple selections.
     dialog.setDirectory("/users/liuzhihao/workstation/programs/esri-shapefile-viewer/sample data");
@@ -71,14 +131,26 @@ void MainWindow::openDataset()
     if (!dialog.exec())
         return;
 
-    bool notInitialized = ShapeView::instance().isEmpty();
+    // Every file is opened in the background, each layer shows up once its index is built.
+    _layerLoader->load(dialog.selectedFiles(), options);
+}
 
-    QStringList fileNames = dialog.selectedFiles();
-    for (auto path : fileNames)
-        ShapeView::instance().addLayer(path.toStdString());
+void MainWindow::showLoadingProgress(int finishedCount, int totalCount)
+{
+    _loadProgress->setRange(0, totalCount);
+    _loadProgress->setValue(finishedCount);
+    _loadProgress->show();
+    _cancelLoading->show();
+}
+
+void MainWindow::finishLoading(QStringList const& failedPaths)
+{
+    _loadProgress->hide();
+    _cancelLoading->hide();
 
-    if (notInitialized)
-        ShapeView::instance().zoomToAll();
+    if (!failedPaths.empty())
+        QMessageBox::warning(this, tr("Open Dataset"),
+                             tr("These files could not be opened:\n") + failedPaths.join("\n"));
 }
 
 void MainWindow::closeAll()
@@ -137,6 +209,146 @@ void MainWindow::layerDown()
     ShapeView::instance().rearrangeLayer(layerItr, --layerItr);
 }
 
+void MainWindow::showAttributeTable()
+{
+    using namespace cl::DataManagement;
+
+    QList<QListWidgetItem*> selection = _sidebar->listSelection();
+    if (selection.empty())
+        return;
+
+    auto layerItr = ShapeView::instance().findByName(selection.front()->text().toStdString());
+    if (ShapeView::instance().layerNotFound(layerItr))
+        return;
+
+    auto const& dataset = (*layerItr)->dataset();
+    if (!_attributeTable->showDataset(dataset->name(), dataset->path()))
+        QMessageBox::warning(this, tr("Attribute Table"), tr("The layer has no readable .dbf file."));
+}
+
+void MainWindow::styleLayerByAttribute()
+{
+    using namespace cl::DataManagement;
+    using namespace cl::Graphics;
+    typedef cl::Dataset::AttributeColumns AttributeColumns;
+
+    QList<QListWidgetItem*> selection = _sidebar->listSelection();
+    if (selection.empty())
+        return;
+
+    auto layerItr = ShapeView::instance().findByName(selection.front()->text().toStdString());
+    if (ShapeView::instance().layerNotFound(layerItr))
+        return;
+
+    AttributeColumns const& attributes = (*layerItr)->dataset()->attributes();
+
+    QStringList fieldNames;
+    std::vector<int> fields;
+    for (int field = 0; field < attributes.fieldCount(); ++field)
+        if (attributes.fieldType(field) != AttributeColumns::ColumnType::String)
+        {
+            fieldNames << QString::fromStdString(attributes.fieldName(field));
+            fields.push_back(field);
+        }
+
+    if (fields.empty())
+    {
+        QMessageBox::warning(this, tr("Style by Attribute"), tr("The layer has no numeric attribute."));
+        return;
+    }
+
+    bool accepted = false;
+    QString fieldName = QInputDialog::getItem(this, tr("Style by Attribute"), tr("Field:"), fieldNames, 0, false, &accepted);
+    if (!accepted)
+        return;
+
+    // In the order of cl::Graphics::Classification.
+    QStringList classifications;
+    classifications << tr("Equal interval") << tr("Quantile") << tr("Natural breaks (Jenks)");
+    QString classification = QInputDialog::getItem(this, tr("Style by Attribute"), tr("Classification:"),
+                                                   classifications, 1, false, &accepted);
+    if (!accepted)
+        return;
+
+    int classCount = QInputDialog::getInt(this, tr("Style by Attribute"), tr("Classes:"),
+                                          5, 2, ThematicStyle::MaxClassCount, 1, &accepted);
+    if (!accepted)
+        return;
+
+    // Light yellow to dark red.
+    std::shared_ptr<ThematicStyle const> style(
+                new ThematicStyle(attributes, fields[fieldNames.indexOf(fieldName)], (*layerItr)->dataset()->recordCount(),
+                                  Classification(classifications.indexOf(classification)), classCount,
+                                  QColor(255, 255, 178), QColor(189, 0, 38)));
+
+    if (!style->isValid())
+    {
+        QMessageBox::warning(this, tr("Style by Attribute"), tr("The field has no value to classify."));
+        return;
+    }
+
+    ShapeView::instance().setThematicStyle(layerItr, style);
+}
+
+void MainWindow::clearLayerStyle()
+{
+    using namespace cl::DataManagement;
+
+    QList<QListWidgetItem*> selection = _sidebar->listSelection();
+    if (selection.empty())
+        return;
+
+    auto layerItr = ShapeView::instance().findByName(selection.front()->text().toStdString());
+    if (ShapeView::instance().layerNotFound(layerItr) || !(*layerItr)->thematicStyle())
+        return;
+
+    ShapeView::instance().setThematicStyle(layerItr, nullptr);
+}
+
+void MainWindow::setDefinitionQuery()
+{
+    using namespace cl::DataManagement;
+    using cl::Dataset::AttributeFilter;
+
+    QList<QListWidgetItem*> selection = _sidebar->listSelection();
+    if (selection.empty())
+        return;
+
+    auto layerItr = ShapeView::instance().findByName(selection.front()->text().toStdString());
+    if (ShapeView::instance().layerNotFound(layerItr))
+        return;
+
+    std::shared_ptr<AttributeFilter const> current = (*layerItr)->attributeFilter();
+
+    bool accepted = false;
+    QString expression = QInputDialog::getText(this, tr("Definition Query"),
+                                               tr("Draw only the records where, e.g. POP > 1e6 AND NAME <> 'Chile'.\n"
+                                                  "Leave empty to draw them all."),
+                                               QLineEdit::Normal,
+                                               current ? QString::fromStdString(current->expression()) : QString(),
+                                               &accepted).trimmed();
+    if (!accepted)
+        return;
+
+    if (expression.isEmpty())
+    {
+        if (current)
+            ShapeView::instance().setAttributeFilter(layerItr, nullptr);
+        return;
+    }
+
+    std::shared_ptr<AttributeFilter const> filter(
+                new AttributeFilter((*layerItr)->dataset()->attributes(), expression.toStdString()));
+
+    if (!filter->isValid())
+    {
+        QMessageBox::warning(this, tr("Definition Query"), QString::fromStdString(filter->error()));
+        return;
+    }
+
+    ShapeView::instance().setAttributeFilter(layerItr, filter);
+}
+
 void MainWindow::createMap(cl::Map::MapStyle mapStyle)
 {
     using namespace cl::Map;
@@ -173,3 +385,98 @@ void MainWindow::createMapNoGridLine()
 {
     createMap(cl::Map::MapStyle::NoGridLine);
 }
+
+void MainWindow::drawSmallFeaturesAsGeometry()
+{
+    cl::DataManagement::ShapeView::instance().setSubPixelMode(cl::Graphics::SubPixelMode::Geometry);
+}
+
+void MainWindow::drawSmallFeaturesAsPixels()
+{
+    cl::DataManagement::ShapeView::instance().setSubPixelMode(cl::Graphics::SubPixelMode::Pixel);
+}
+
+void MainWindow::drawSmallFeaturesAsDensity()
+{
+    cl::DataManagement::ShapeView::instance().setSubPixelMode(cl::Graphics::SubPixelMode::Density);
+}
+
+void MainWindow::benchmarkSpatialIndex()
+{
+    using namespace cl::DataManagement;
+
+    if (ShapeView::instance().isEmpty())
+        return;
+
+    // The windows are the size of the current view, as a pan or zoom would query.
+    QString report = cl::Benchmark::spatialIndex(ShapeView::instance().shapeDoc(),
+                                                 ShapeView::instance().assistant().computeMapHitBounds());
+
+    QMessageBox::information(this, tr("Spatial Index Benchmark"), report);
+}
+
+void MainWindow::benchmarkTransform()
+{
+    using namespace cl::DataManagement;
+
+    if (ShapeView::instance().isEmpty())
+        return;
+
+    QString report = cl::Benchmark::transformKernel(ShapeView::instance().assistant());
+
+    QMessageBox::information(this, tr("Transform Benchmark"), report);
+}
+
+void MainWindow::benchmarkTileRasterization()
+{
+    using namespace cl::DataManagement;
+
+    if (ShapeView::instance().isEmpty())
+        return;
+
+    QString report = cl::Benchmark::tileRasterization(ShapeView::instance().shapeDoc(),
+                                                      ShapeView::instance().assistant(),
+                                                      _viewForm->size());
+
+    QMessageBox::information(this, tr("Tile Rasterization Benchmark"), report);
+}
+
+void MainWindow::benchmarkAttributeScan()
+{
+    using namespace cl::DataManagement;
+
+    if (ShapeView::instance().isEmpty())
+        return;
+
+    QString report = cl::Benchmark::attributeScan(ShapeView::instance().shapeDoc());
+
+    QMessageBox::information(this, tr("Attribute Scan Benchmark"), report);
+}
+
+void MainWindow::reportMemoryUsage()
+{
+    using namespace cl::DataManagement;
+
+    if (ShapeView::instance().isEmpty())
+        return;
+
+    QString report = cl::Benchmark::memoryUsage(ShapeView::instance().shapeDoc());
+
+    QMessageBox::information(this, tr("Layer Memory Usage"), report);
+}
+
+// Datasets of closed layers stay open for a later open until they take more than this.
+void MainWindow::setClosedLayerBudget()
+{
+    using cl::Dataset::DatasetRegistry;
+
+    DatasetRegistry& registry = DatasetRegistry::instance();
+
+    bool accepted = false;
+    int budgetMB = QInputDialog::getInt(this, tr("Closed Layer Budget"), tr("Memory kept for closed layers (MB):"),
+                                        int(registry.budget() >> 20), 0, 1 << 20, 64, &accepted);
+    if (!accepted)
+        return;
+
+    registry.setBudget(std::size_t(budgetMB) << 20);
+}
@@ -7,8 +7,13 @@
 #include "mapwindow.h"
 #include "shapemanager.h"
 #include "map.h"
+#include "layerloader.h"
+#include "attributetable.h"
 
 class QLabel;
+class QActionGroup;
+class QProgressBar;
+class QPushButton;
 
 namespace Ui { class MainWindow; }
 
@@ -28,20 +33,46 @@ private:
 
     std::unique_ptr<ViewForm> _viewForm;
     std::unique_ptr<Sidebar> _sidebar;
+    std::unique_ptr<AttributeTable> _attributeTable;
     std::unique_ptr<QLabel> _msgLabel;
     std::unique_ptr<MapWindow> _mapWindow;
+    std::unique_ptr<QActionGroup> _smallFeaturesGroup;
 
+    // Opens datasets in the background, with its progress in the status bar.
+    std::unique_ptr<LayerLoader> _layerLoader;
+    std::unique_ptr<QProgressBar> _loadProgress;
+    std::unique_ptr<QPushButton> _cancelLoading;
+
+    void openDatasets(cl::Dataset::OpenOptions const& options);
     void createMap(cl::Map::MapStyle mapStyle);
 
 private slots:
     void openDataset();
+    void openDatasetResident();
+    void showLoadingProgress(int finishedCount, int totalCount);
+    void finishLoading(QStringList const& failedPaths);
     void closeAll();
     void removeLayer();
     void layerUp();
     void layerDown();
+    void showAttributeTable();
+    void styleLayerByAttribute();
+    void clearLayerStyle();
+    void setDefinitionQuery();
 
     void createMapFullElements();
     void createMapNoGridLine();
+
+    void drawSmallFeaturesAsGeometry();
+    void drawSmallFeaturesAsPixels();
+    void drawSmallFeaturesAsDensity();
+
+    void benchmarkSpatialIndex();
+    void benchmarkTransform();
+    void benchmarkTileRasterization();
+    void benchmarkAttributeScan();
+    void reportMemoryUsage();
+    void setClosedLayerBudget();
 };
 
 #endif // MAINWINDOW_H
@@ -10,8 +10,19 @@ namespace Dataset
 {
 class ShapeDatasetShared;
 class ShapeRecordUnique;
+class ShapeRecordView;
+class PointSpan;
+class PackedRTree;
+class LodPyramid;
+class GeometryStore;
+class DatasetRegistry;
+class AttributeColumns;
+class AttributeFilter;
 
 enum class ShapeType;
+enum class AccessMode;
+enum class IndexType;
+struct OpenOptions;
 }
 
 namespace Graphics
@@ -24,6 +35,11 @@ class Polyline;
 class Polygon;
 
 class GraphicAssistant;
+struct DrawStats;
+enum class SubPixelMode;
+class TileCache;
+class ThematicStyle;
+enum class Classification;
 }
 
 namespace DataManagement
@@ -57,9 +73,13 @@ class NorthPointer;
 class ScaleBar;
 }
 
+class WorkStealingPool;
+
 template<typename T> class Pair;
 template<typename T> class Rect;
 
+template<typename T> T readLittleEndian(unsigned char const* bytes);
+
 typedef std::list<std::shared_ptr<Graphics::Shape>>::iterator LayerIterator;
 }
 #endif // NSDEF_H
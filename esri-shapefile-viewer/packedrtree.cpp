@@ -0,0 +1,76 @@
+#include "packedrtree.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace cl;
+
+int const Dataset::PackedRTree::NodeCapacity;
+
+Dataset::PackedRTree::PackedRTree(std::vector<Entry> leaves)
+    : _entries(std::move(leaves)), _leafCount(int(_entries.size()))
+{
+    if (_entries.empty())
+        return;
+
+    auto centerX = [](Entry const& entry) { return entry.xMin + entry.xMax; };
+    auto centerY = [](Entry const& entry) { return entry.yMin + entry.yMax; };
+
+    // Sort-Tile-Recursive: sort by x, cut into vertical slices of about
+    // sqrt(leaf node count) nodes each, then sort every slice by y.
+    int leafNodeCount = (_leafCount + NodeCapacity - 1) / NodeCapacity;
+    int sliceCount = int(std::ceil(std::sqrt(double(leafNodeCount))));
+    int sliceSize = sliceCount * NodeCapacity;
+
+    std::sort(_entries.begin(), _entries.end(),
+              [&](Entry const& a, Entry const& b) { return centerX(a) < centerX(b); });
+
+    for (int sliceStart = 0; sliceStart < _leafCount; sliceStart += sliceSize)
+    {
+        auto sliceEnd = _entries.begin() + std::min(_leafCount, sliceStart + sliceSize);
+        std::sort(_entries.begin() + sliceStart, sliceEnd,
+                  [&](Entry const& a, Entry const& b) { return centerY(a) < centerY(b); });
+    }
+
+    // Pack each level into parents of NodeCapacity consecutive entries until a single root is left.
+    std::size_t totalCount = _leafCount;
+    for (std::size_t levelCount = _leafCount; levelCount > 1; levelCount = (levelCount + NodeCapacity - 1) / NodeCapacity)
+        totalCount += (levelCount + NodeCapacity - 1) / NodeCapacity;
+    _entries.reserve(totalCount);
+
+    int levelStart = 0;
+    int levelCount = _leafCount;
+    while (levelCount > 1)
+    {
+        int levelEnd = levelStart + levelCount;
+        for (int first = levelStart; first < levelEnd; first += NodeCapacity)
+        {
+            int count = std::min(NodeCapacity, levelEnd - first);
+
+            Entry parent = _entries[first];
+            for (int i = first + 1; i < first + count; ++i)
+            {
+                parent.xMin = std::min(parent.xMin, _entries[i].xMin);
+                parent.yMin = std::min(parent.yMin, _entries[i].yMin);
+                parent.xMax = std::max(parent.xMax, _entries[i].xMax);
+                parent.yMax = std::max(parent.yMax, _entries[i].yMax);
+            }
+            parent.first = first;
+            parent.count = count;
+
+            _entries.push_back(parent);
+        }
+
+        levelStart = levelEnd;
+        levelCount = int(_entries.size()) - levelStart;
+    }
+}
+
+std::vector<int> Dataset::PackedRTree::query(Rect<double> const& box) const
+{
+    std::vector<int> recordsHit;
+    visit(box, [&recordsHit](int recordId) { recordsHit.push_back(recordId); });
+
+    // Ascending ids keep the record reads as sequential as possible.
+    std::sort(recordsHit.begin(), recordsHit.end());
+    return recordsHit;
+}
@@ -0,0 +1,74 @@
+#ifndef PACKEDRTREE_H
+#define PACKEDRTREE_H
+
+#include <vector>
+#include <cstddef>
+#include "nsdef.h"
+#include "support.h"
+
+// A static R-tree bulk loaded with Sort-Tile-Recursive packing.
+// All entries live in one contiguous array, level by level from the leaves up,
+// and the children of an entry are the consecutive entries [first, first + count)
+// of the level below. The leaf entries are the record boxes themselves,
+// so a query yields exactly the records whose bounds intersect the search box.
+class cl::Dataset::PackedRTree
+{
+public:
+    struct Entry
+    {
+        double xMin, yMin, xMax, yMax;
+        int first; // The record id of a leaf, the index of the first child otherwise.
+        int count; // Zero for a leaf.
+    };
+
+    static int const NodeCapacity = 16;
+
+    PackedRTree() = default;
+
+    // Every leaf must have its record id in first and a count of zero.
+    explicit PackedRTree(std::vector<Entry> leaves);
+
+    bool isEmpty() const { return _entries.empty(); }
+    int recordCount() const { return _leafCount; }
+    std::size_t memoryUsage() const { return _entries.capacity() * sizeof(Entry); }
+
+    // Call visitor(recordId) for every record whose box intersects the search box, in tree order.
+    template<typename Visitor>
+    void visit(Rect<double> const& box, Visitor&& visitor) const;
+
+    // The ids of the records whose box intersects the search box, in ascending order.
+    std::vector<int> query(Rect<double> const& box) const;
+
+private:
+    std::vector<Entry> _entries;
+    int _leafCount = 0;
+};
+
+template<typename Visitor>
+void cl::Dataset::PackedRTree::visit(Rect<double> const& box, Visitor&& visitor) const
+{
+    if (_entries.empty())
+        return;
+
+    // Depth first, so the stack never holds more than NodeCapacity entries per level.
+    int stack[256];
+    int top = 0;
+    stack[top++] = int(_entries.size()) - 1;
+
+    while (top > 0)
+    {
+        Entry const& entry = _entries[stack[--top]];
+
+        if (entry.xMax < box.xMin() || entry.xMin > box.xMax()
+                || entry.yMax < box.yMin() || entry.yMin > box.yMax())
+            continue;
+
+        if (entry.count == 0)
+            visitor(entry.first);
+        else
+            for (int child = entry.first + entry.count - 1; child >= entry.first; --child)
+                stack[top++] = child;
+    }
+}
+
+#endif // PACKEDRTREE_H
@@ -0,0 +1,156 @@
+#include "renderthread.h"
+#include <QPainter>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <cmath>
+#include "shapedata.h"
+
+using namespace cl;
+
+RenderThread::RenderThread(QObject* parent)
+    : QThread(parent), _restart(false), _abort(false), _cancel(false), _lastDocRevision(0),
+      _tileCache(&_pool) {}
+
+RenderThread::~RenderThread()
+{
+    _mutex.lock();
+    _abort = true;
+    _cancel = true;
+    _condition.wakeOne();
+    _mutex.unlock();
+
+    wait();
+}
+
+void RenderThread::render(DataManagement::ShapeDoc const& shapeDoc,
+                          Graphics::GraphicAssistant const& assistant, QSize const& size)
+{
+    QMutexLocker locker(&_mutex);
+
+    _shapeDoc = shapeDoc;
+    _assistant.reset(new Graphics::GraphicAssistant(assistant, _shapeDoc));
+    _size = size;
+
+    if (!isRunning())
+    {
+        start(LowPriority);
+    }
+    else
+    {
+        _restart = true;
+        _cancel = true;
+        _condition.wakeOne();
+    }
+}
+
+void RenderThread::run()
+{
+    forever
+    {
+        // Take a private copy of the request, the GUI thread may replace it at any time.
+        _mutex.lock();
+        DataManagement::ShapeDoc shapeDoc = _shapeDoc;
+        Graphics::GraphicAssistant assistant(*_assistant, shapeDoc);
+        QSize size = _size;
+        _restart = false;
+        _cancel = false;
+        _mutex.unlock();
+
+        assistant.setCancelFlag(&_cancel);
+
+        QElapsedTimer renderTimer;
+        renderTimer.start();
+
+        QImage image(size, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+
+        QPainter painter(&image);
+        Graphics::DrawStats stats;
+
+        QRect frameRect(QPoint(0, 0), size);
+
+        QPoint offset;
+        if (computePanOffset(assistant, size, shapeDoc.revision(), offset))
+        {
+            // Shift the last frame and fill in the uncovered strips only,
+            // from the tiles that cover them.
+            painter.drawImage(offset, _lastFrame);
+
+            QRect columnStrip = offset.x() > 0 ? QRect(0, 0, offset.x(), size.height())
+                                               : QRect(size.width() + offset.x(), 0, -offset.x(), size.height());
+            QRect rowStrip = offset.y() > 0 ? QRect(0, 0, size.width(), offset.y())
+                                            : QRect(0, size.height() + offset.y(), size.width(), -offset.y());
+
+            // The corner both strips share is left to the column strip.
+            if (offset.x() > 0)
+                rowStrip.setLeft(offset.x());
+            else
+                rowStrip.setRight(size.width() + offset.x() - 1);
+
+            for (QRect const& strip : {columnStrip, rowStrip})
+            {
+                if (strip.isEmpty())
+                    continue;
+
+                painter.setClipRect(strip & frameRect);
+                stats += _tileCache.draw(painter, shapeDoc, assistant, strip);
+            }
+        }
+        else
+        {
+            stats = _tileCache.draw(painter, shapeDoc, assistant, frameRect);
+        }
+        painter.end();
+
+        if (_abort)
+            return;
+
+        if (!assistant.isCancelled())
+        {
+            Pair<double> mapTopLeft = assistant.displayToMapXY(Pair<int>(0, 0));
+            Pair<double> mapBottomRight = assistant.displayToMapXY(Pair<int>(size.width(), size.height()));
+            emit renderedImage(image, QRectF(QPointF(mapTopLeft.x(), mapTopLeft.y()),
+                                             QPointF(mapBottomRight.x(), mapBottomRight.y())),
+                               shapeDoc.describeDraw(stats, renderTimer.elapsed()));
+
+            _lastFrame = image;
+            _lastAssistant.reset(new Graphics::GraphicAssistant(assistant, shapeDoc));
+            _lastDocRevision = shapeDoc.revision();
+        }
+
+        _mutex.lock();
+        if (!_restart && !_abort)
+            _condition.wait(&_mutex);
+        _mutex.unlock();
+
+        if (_abort)
+            return;
+    }
+}
+
+// A frame can be reused when the layers, the size and the scale are unchanged
+// and the view only moved by whole pixels, less than a frame in each direction.
+bool RenderThread::computePanOffset(Graphics::GraphicAssistant const& assistant, QSize const& size,
+                                    unsigned long docRevision, QPoint& offset) const
+{
+    if (_lastFrame.isNull() || _lastFrame.size() != size || _lastDocRevision != docRevision
+            || _lastAssistant->scale() != assistant.scale())
+        return false;
+
+    // Where the old frame's origin lands now. Rounding below a thousandth of a pixel
+    // comes from re-anchoring the view when a drag starts, not from a real move.
+    Pair<double> mapOrigin = _lastAssistant->displayToMapXY(Pair<int>(0, 0));
+    Pair<double> shift = (mapOrigin - assistant.displayToMapXY(Pair<int>(0, 0)))
+            * Pair<double>(1, -1) * double(assistant.scale());
+
+    double shiftX = std::round(shift.x());
+    double shiftY = std::round(shift.y());
+    if (std::abs(shift.x() - shiftX) > 1e-3 || std::abs(shift.y() - shiftY) > 1e-3)
+        return false;
+
+    if (std::abs(shiftX) >= size.width() || std::abs(shiftY) >= size.height() || (shiftX == 0 && shiftY == 0))
+        return false;
+
+    offset = QPoint(int(shiftX), int(shiftY));
+    return true;
+}
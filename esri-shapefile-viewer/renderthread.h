@@ -0,0 +1,66 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QRectF>
+#include <QSize>
+#include <atomic>
+#include <memory>
+#include "shapemanager.h"
+#include "tilecache.h"
+#include "workstealingpool.h"
+
+// Draws the layers into an off-screen image away from the GUI thread.
+// A new request cancels the frame in progress and starts over with the latest view,
+// finished frames are handed back through renderedImage(). Frames are put together
+// from a tile cache, and a pan at the same scale reuses the previous frame and
+// only fills in the strips it uncovers.
+class RenderThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit RenderThread(QObject* parent = nullptr);
+    ~RenderThread();
+
+    // Only the list of layers is copied, the layers themselves are shared.
+    void render(cl::DataManagement::ShapeDoc const& shapeDoc,
+                cl::Graphics::GraphicAssistant const& assistant, QSize const& size);
+
+signals:
+    // The map coordinates of the image's top left and bottom right corners are given
+    // as a rectangle, so the frame can be placed under a view that has moved since.
+    void renderedImage(QImage const& image, QRectF const& mapCorners, QString const& status);
+
+protected:
+    virtual void run() override;
+
+private:
+    bool computePanOffset(cl::Graphics::GraphicAssistant const& assistant, QSize const& size,
+                          unsigned long docRevision, QPoint& offset) const;
+
+    QMutex _mutex;
+    QWaitCondition _condition;
+
+    cl::DataManagement::ShapeDoc _shapeDoc;
+    std::unique_ptr<cl::Graphics::GraphicAssistant> _assistant;
+    QSize _size;
+
+    // Set under _mutex, but _abort is also polled without it between the steps of a frame.
+    std::atomic<bool> _restart;
+    std::atomic<bool> _abort;
+    std::atomic<bool> _cancel; // Raised with _restart or _abort, read by the drawing code.
+
+    // The last frame finished, only touched by the render thread.
+    QImage _lastFrame;
+    std::unique_ptr<cl::Graphics::GraphicAssistant> _lastAssistant;
+    unsigned long _lastDocRevision;
+
+    cl::WorkStealingPool _pool; // Rasterizes the missing tiles of a frame in parallel.
+    cl::Graphics::TileCache _tileCache;
+};
+
+#endif // RENDERTHREAD_H
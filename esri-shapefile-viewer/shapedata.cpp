@@ -2,12 +2,98 @@
 #include <QPoint>
 #include <QPainter>
 #include <QColor>
+#include <QImage>
 #include <QFileInfo>
 #include <QTime>
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <thread>
 #include "shapemanager.h"
+#include "datasetregistry.h"
+#include "thematicstyle.h"
+#include "attributefilter.h"
+#ifdef CL_HAVE_SSE2
+#include <emmintrin.h>
+#endif
 
 using namespace cl;
 
+// Scratch buffers for drawing, kept across frames. They only grow to the largest view
+// and part drawn, so steady-state draws do not allocate, and there is one set per
+// thread since tiles of the same layer are drawn concurrently.
+static thread_local std::vector<int> drawRecordsHit;
+static thread_local std::vector<QPoint> drawPartVertices;
+static thread_local std::vector<int> drawSubPixelHit;
+static thread_local std::vector<int> drawDensityCounts;
+static thread_local std::vector<int> drawStyleStarts;
+static thread_local std::vector<int> drawSubPixelStyleStarts;
+
+// The record buffer of this thread for datasets that are not mapped, so that
+// any number of threads can read the same dataset at once.
+namespace
+{
+struct ReadContext
+{
+    SHPReadContext context = {nullptr, 0};
+    ~ReadContext() { SHPFreeReadContext(&context); }
+};
+}
+
+static thread_local ReadContext threadReadContext;
+
+// Drop the vertices that add nothing once on the display: repeats of the previous
+// pixel and the inner vertices of straight runs going one way. The rest are moved
+// to the front and counted, the first and last pixels are always kept.
+static int decimateOnDisplay(QPoint* points, int count)
+{
+    if (count < 2)
+        return count;
+
+    int keptCount = 1;
+    for (int i = 1; i < count; ++i)
+    {
+        QPoint const point = points[i];
+        if (point == points[keptCount - 1])
+            continue;
+
+        if (keptCount >= 2)
+        {
+            QPoint const& a = points[keptCount - 2];
+            QPoint const& b = points[keptCount - 1];
+            qint64 cross = qint64(b.x() - a.x()) * (point.y() - b.y()) - qint64(b.y() - a.y()) * (point.x() - b.x());
+            qint64 dot = qint64(b.x() - a.x()) * (point.x() - b.x()) + qint64(b.y() - a.y()) * (point.y() - b.y());
+
+            // b lies on the way from a to the new point, which replaces it.
+            if (cross == 0 && dot > 0)
+            {
+                points[keptCount - 1] = point;
+                continue;
+            }
+        }
+
+        points[keptCount++] = point;
+    }
+
+    return keptCount;
+}
+
+// The nearest float not above, or not below, the given value.
+static float roundDown(double value)
+{
+    float rounded = float(value);
+    return double(rounded) > value ? std::nextafter(rounded, -std::numeric_limits<float>::infinity()) : rounded;
+}
+
+static float roundUp(double value)
+{
+    float rounded = float(value);
+    return double(rounded) < value ? std::nextafter(rounded, std::numeric_limits<float>::infinity()) : rounded;
+}
+
 class cl::Graphics::Shape::Private
 {
     friend class Shape;
@@ -20,15 +106,62 @@ private:
     Private(Shape& refThis, Dataset::ShapeDatasetShared const& ptrDataset)
         : _refThis(refThis), _ptrDataset(ptrDataset)
     {
-        qsrand(QTime::currentTime().second());
+        // Layers opened in the same second, possibly on different threads, still differ.
+        static std::atomic<uint> shapeCount(0);
+        qsrand(QTime::currentTime().second() + 7919 * shapeCount++);
         _borderColor = QColor::fromHsl(qrand()%360, qrand()%256, qrand()%200);
         _fillColor = QColor::fromHsl(qrand()%360, qrand()%256, qrand()%256);
     }
 
+    // Call drawRecords(first, last, color) for the records of every style of the
+    // layer in turn, with the style's pen and brush set, or once for all of them
+    // with the layer's own colors. The records are reordered by style.
+    template<typename DrawRecords>
+    void drawByStyle(QPainter& painter, std::vector<int>& records, std::vector<int>& styleStarts,
+                     DrawRecords drawRecords) const
+    {
+        if (records.empty())
+            return;
+
+        if (!_thematicStyle || !_thematicStyle->isValid())
+        {
+            painter.setPen(QPen(_borderColor));
+            painter.setBrush(QBrush(_fillColor));
+            drawRecords(records.data(), records.data() + records.size(), _borderColor);
+            return;
+        }
+
+        _thematicStyle->groupByStyle(records, styleStarts);
+
+        for (int style = 0; style < _thematicStyle->styleCount(); ++style)
+        {
+            if (styleStarts[style] == styleStarts[style + 1])
+                continue;
+
+            painter.setPen(_thematicStyle->pen(style));
+            painter.setBrush(_thematicStyle->brush(style));
+            drawRecords(records.data() + styleStarts[style], records.data() + styleStarts[style + 1],
+                        _thematicStyle->color(style));
+        }
+    }
+
+    // Drop the candidates the definition query leaves out, before any is read.
+    void filterRecords(std::vector<int>& records, DrawStats& stats) const
+    {
+        if (!_attributeFilter || !_attributeFilter->isValid())
+            return;
+
+        std::size_t candidateCount = records.size();
+        _attributeFilter->removeUnselected(records);
+        stats.filteredCount = int(candidateCount - records.size());
+    }
+
     Shape& _refThis;
 
     Dataset::ShapeDatasetShared _ptrDataset;
     QColor _borderColor, _fillColor; // Each object has a different but fixed color set.
+    std::shared_ptr<ThematicStyle const> _thematicStyle;
+    std::shared_ptr<Dataset::AttributeFilter const> _attributeFilter;
 };
 
 // Defined here to ensure the unique pointer of ShapePrivate to be destructed properly.
@@ -47,14 +180,16 @@ std::unique_ptr<DataManagement::ShapeFactory> DataManagement::ShapeFactoryEsri::
 
 DataManagement::ShapeFactory const& DataManagement::ShapeFactoryEsri::instance()
 {
-    if (_instance == nullptr)
-        _instance.reset(new ShapeFactoryEsri());
+    // Layers are opened from several threads at once.
+    static std::once_flag created;
+    std::call_once(created, [] { _instance.reset(new ShapeFactoryEsri()); });
     return *_instance;
 }
 
-std::shared_ptr<Graphics::Shape> DataManagement::ShapeFactoryEsri::createShape(std::string const& path) const
+std::shared_ptr<Graphics::Shape> DataManagement::ShapeFactoryEsri::createShape(std::string const& path,
+                                                                               Dataset::OpenOptions const& options) const
 {
-    Dataset::ShapeDatasetShared ptrDataset(path);
+    Dataset::ShapeDatasetShared ptrDataset = Dataset::DatasetRegistry::instance().open(path, options);
     switch (ptrDataset->type())
     {
     case Dataset::ShapeType::Point:
@@ -75,55 +210,210 @@ std::shared_ptr<Graphics::Shape> DataManagement::ShapeFactoryEsri::createShape(s
     }
 }
 
-int Graphics::Point::draw(QPainter& painter, GraphicAssistant const& assistant) const
+Graphics::DrawStats Graphics::Point::draw(QPainter& painter, GraphicAssistant const& assistant) const
+{
+    DrawStats stats;
+    Rect<double> mapHitBounds = assistant.computeMapHitBounds();
+    std::vector<int>& recordsHit = drawRecordsHit;
+    _private->_ptrDataset->filterRecords(mapHitBounds, _private->_ptrDataset->indexType(), recordsHit);
+    stats.candidateCount = int(recordsHit.size());
+
+    _private->filterRecords(recordsHit, stats);
+    _private->_ptrDataset->refineRecords(mapHitBounds, recordsHit);
+    stats.hitCount = int(recordsHit.size());
+
+    _private->drawByStyle(painter, recordsHit, drawStyleStarts, [&](int const* first, int const* last, QColor const&)
+    {
+        for (int const* position = first; position != last; ++position)
+        {
+            int const item = *position;
+            if (assistant.isCancelled())
+                break;
+
+            QPoint point;
+            if (_private->_ptrDataset->isResident())
+            {
+                Dataset::GeometryStore const& geometry = _private->_ptrDataset->residentGeometry();
+                int partIndex = geometry.firstPart(item);
+                if (partIndex == geometry.firstPart(item + 1) || geometry.partSize(partIndex) == 0)
+                    continue;
+
+                assistant.computePointsOnDisplay(geometry.recordOrigin(item), geometry.partXs(partIndex),
+                                                 geometry.partYs(partIndex), 1, &point);
+            }
+            else
+            {
+                Dataset::ShapeRecordView record = _private->_ptrDataset.viewRecord(item);
+                if (record.vertexCount() == 0)
+                    continue;
+
+                point = assistant.computePointOnDisplay(record.points(), 0).toQPoint();
+            }
+            ++stats.inputVertexCount;
+            ++stats.emittedVertexCount;
+
+            painter.drawEllipse(point, MarkerRadius, MarkerRadius);
+        }
+    });
+
+    return stats;
+}
+
+Graphics::DrawStats Graphics::MultiPartShape::draw(QPainter& painter, GraphicAssistant const& assistant) const
 {
+    DrawStats stats;
     Rect<double> mapHitBounds = assistant.computeMapHitBounds();
-    std::vector<int> recordsHit = _private->_ptrDataset->filterRecords(mapHitBounds);
+    std::vector<int>& recordsHit = drawRecordsHit;
+    _private->_ptrDataset->filterRecords(mapHitBounds, _private->_ptrDataset->indexType(), recordsHit);
+    stats.candidateCount = int(recordsHit.size());
 
-    painter.setPen(QPen(_private->_borderColor));
-    painter.setBrush(QBrush(_private->_fillColor));
+    _private->filterRecords(recordsHit, stats);
+    _private->_ptrDataset->refineRecords(mapHitBounds, recordsHit);
+    stats.hitCount = int(recordsHit.size());
 
-    for (auto item : recordsHit)
+    // Records within a pixel are drawn from their bounds, without reading them.
+    if (assistant.subPixelMode() != SubPixelMode::Geometry)
     {
-        Dataset::ShapeRecordUnique ptrRecord = _private->_ptrDataset.readRecord(item);
-        QPoint point = assistant.computePointOnDisplay(*ptrRecord, 0).toQPoint();
+        std::vector<int>& subPixelHit = drawSubPixelHit;
+        _private->_ptrDataset->cullSubPixelRecords(assistant.scale(), recordsHit, subPixelHit);
+        stats.subPixelCount = int(subPixelHit.size());
 
-        int const r = 5;
+        _private->drawByStyle(painter, subPixelHit, drawSubPixelStyleStarts,
+                              [&](int const* first, int const* last, QColor const& color)
+        {
+            drawSubPixelRecords(painter, assistant, first, int(last - first), color);
+        });
+    }
+
+    std::vector<QPoint>& partVertices = drawPartVertices;
 
-        painter.drawEllipse(point, r, r);
+    // Zoomed out, a simplified copy looks the same and has far fewer vertices. It is
+    // built in the background the first time a view is out far enough to use it,
+    // the records are read as usual until it is done. A resident layer is drawn
+    // without touching the file.
+    Dataset::LodPyramid::Level const* level = nullptr;
+    if (assistant.scale() < Dataset::LodPyramid::maxLevelScale(_private->_ptrDataset->bounds()))
+    {
+        if (Dataset::LodPyramid const* pyramid = _private->_ptrDataset->lodPyramid())
+            level = pyramid->selectLevel(assistant.scale());
+        else
+            _private->_ptrDataset->buildLodPyramid();
     }
+    Dataset::GeometryStore const* geometry = level ? &level->geometry
+            : _private->_ptrDataset->isResident() ? &_private->_ptrDataset->residentGeometry() : nullptr;
 
-    return int(recordsHit.size());
+    _private->drawByStyle(painter, recordsHit, drawStyleStarts, [&](int const* first, int const* last, QColor const&)
+    {
+        for (int const* position = first; position != last; ++position)
+        {
+            if (assistant.isCancelled())
+                break;
+
+            if (geometry)
+            {
+                drawStored(painter, assistant, *geometry, *position, stats);
+                continue;
+            }
+
+            Dataset::ShapeRecordView record = _private->_ptrDataset.viewRecord(*position);
+
+            for (int partIndex = 0; partIndex < record.partCount(); ++partIndex)
+            {
+                Dataset::PointSpan partPoints = record.partPoints(partIndex);
+                if (partPoints.size() == 0)
+                    continue;
+
+                partVertices.resize(partPoints.size());
+                assistant.computePointsOnDisplay(partPoints, partVertices.data());
+
+                drawOnDisplay(painter, partVertices.data(), partPoints.size(), stats);
+            }
+        }
+    });
+
+    return stats;
 }
 
-int Graphics::MultiPartShape::draw(QPainter& painter, GraphicAssistant const& assistant) const
+void Graphics::MultiPartShape::drawStored(QPainter& painter, GraphicAssistant const& assistant,
+                                         Dataset::GeometryStore const& geometry, int recordId, DrawStats& stats) const
 {
-    Rect<double> mapHitBounds = assistant.computeMapHitBounds();
-    std::vector<int> recordsHit = _private->_ptrDataset->filterRecords(mapHitBounds);
+    std::vector<QPoint>& partVertices = drawPartVertices;
+
+    for (int partIndex = geometry.firstPart(recordId); partIndex < geometry.firstPart(recordId + 1); ++partIndex)
+    {
+        int partSize = geometry.partSize(partIndex);
+        if (partSize == 0)
+            continue;
+
+        partVertices.resize(partSize);
+        assistant.computePointsOnDisplay(geometry.recordOrigin(recordId), geometry.partXs(partIndex),
+                                         geometry.partYs(partIndex), partSize, partVertices.data());
+
+        drawOnDisplay(painter, partVertices.data(), partSize, stats);
+    }
+}
+
+void Graphics::MultiPartShape::drawSubPixelRecords(QPainter& painter, GraphicAssistant const& assistant,
+                                                  int const* records, int recordCount, QColor const& color) const
+{
+    if (recordCount == 0)
+        return;
 
-    painter.setPen(QPen(_private->_borderColor));
-    painter.setBrush(QBrush(_private->_fillColor));
+    std::vector<QPoint>& points = drawPartVertices;
+    points.resize(recordCount);
+    for (int i = 0; i < recordCount; ++i)
+        points[i] = assistant.mapToDisplayXY(_private->_ptrDataset->recordCenter(records[i])).toQPoint();
 
-    for (auto item : recordsHit)
+    if (assistant.subPixelMode() == SubPixelMode::Pixel)
     {
-        Dataset::ShapeRecordUnique ptrRecord = _private->_ptrDataset.readRecord(item);
-        ptrRecord->panPartStart[ptrRecord->nParts] = ptrRecord->nVertices;
+        painter.drawPoints(points.data(), int(points.size()));
+        return;
+    }
 
-        for (int partIndex = 0; partIndex < ptrRecord->nParts; ++partIndex)
-        {
-            int nPartVertices = ptrRecord->panPartStart[partIndex + 1] - ptrRecord->panPartStart[partIndex];
-            QPoint* partVertices = new QPoint[nPartVertices];
+    // Count the records per pixel of the painting rect.
+    Rect<int> const& paintingRect = assistant.paintingRect();
+    int const width = paintingRect.xRange() + 1, height = paintingRect.yRange() + 1;
+    if (width <= 0 || height <= 0)
+        return;
+
+    std::vector<int>& counts = drawDensityCounts;
+    counts.assign(std::size_t(width) * height, 0);
 
-            int count = 0;
-            for (int vtxIndex = ptrRecord->panPartStart[partIndex]; vtxIndex < ptrRecord->panPartStart[partIndex + 1]; ++vtxIndex)
-                partVertices[count++] = assistant.computePointOnDisplay(*ptrRecord, vtxIndex).toQPoint();
+    for (auto const& point : points)
+    {
+        int x = point.x() - paintingRect.xMin(), y = point.y() - paintingRect.yMin();
+        if (x >= 0 && x < width && y >= 0 && y < height)
+            ++counts[std::size_t(y) * width + x];
+    }
 
-            drawPart(painter, partVertices, nPartVertices);
-            delete[] partVertices;
+    // A fixed ramp rather than one scaled to the densest pixel, so that adjacent tiles agree.
+    QImage density(width, height, QImage::Format_ARGB32_Premultiplied);
+
+    for (int y = 0; y < height; ++y)
+    {
+        QRgb* line = reinterpret_cast<QRgb*>(density.scanLine(y));
+        for (int x = 0; x < width; ++x)
+        {
+            int count = counts[std::size_t(y) * width + x];
+            int alpha = count == 0 ? 0 : std::min(255, 64 + int(48 * std::log2(double(count))));
+            line[x] = qPremultiply(qRgba(color.red(), color.green(), color.blue(), alpha));
         }
     }
 
-    return int(recordsHit.size());
+    painter.drawImage(QPoint(paintingRect.xMin(), paintingRect.yMin()), density);
+}
+
+void Graphics::MultiPartShape::drawOnDisplay(QPainter& painter, QPoint* points, int pointCount, DrawStats& stats) const
+{
+    stats.inputVertexCount += pointCount;
+
+    pointCount = decimateOnDisplay(points, pointCount);
+    stats.emittedVertexCount += pointCount;
+
+    if (pointCount == 1)
+        painter.drawPoint(points[0]);
+    else
+        drawPart(painter, points, pointCount);
 }
 
 void Graphics::Polyline::drawPart(QPainter& painter, QPoint const* points, int pointCount) const
@@ -142,16 +432,30 @@ int Graphics::Shape::recordCount() const
     return _private->_ptrDataset->recordCount();
 }
 
-Dataset::ShapeDatasetShared::RC::RC(std::string const& path)
-    : _shpHandle(nullptr), _shpTree(nullptr), _refCount(1)
+Dataset::ShapeDatasetShared::RC::RC(std::string const& path, OpenOptions const& options)
+    : _shpHandle(nullptr), _shpTree(nullptr), _diskTree(nullptr), _indexType(options.indexType), _maxScanThreads(options.maxScanThreads),
+      _packedRTreeReady(false), _lodPyramidCancel(false), _lodPyramidReady(false), _resident(options.resident), _attributesReady(false), _type(ShapeType::Unknown), _refCount(1), _registered(false)
 {
-    _shpHandle = SHPOpen(path.c_str(), "rb+");
+    // "rbm" keeps both files mapped read-only, SHPOpen falls back to stdio if mapping fails.
+    _shpHandle = SHPOpen(path.c_str(), options.accessMode == AccessMode::Mapped ? "rbm" : "rb+");
+    if (_shpHandle == nullptr)
+        return;
 
-    _shpTree = SHPCreateTree(_shpHandle, 2, 10, nullptr, nullptr);
-    SHPTreeTrimExtraNodes(_shpTree);
+    _recordXMin.resize(_shpHandle->nRecords);
+    _recordYMin.resize(_shpHandle->nRecords);
+    _recordXMax.resize(_shpHandle->nRecords);
+    _recordYMax.resize(_shpHandle->nRecords);
+
+    loadOrBuildIndex(path, options.persistentIndex);
+    if (_indexType == IndexType::PackedRTree)
+        packedRTree();
+
+    if (_resident)
+        _residentGeometry = GeometryStore(_shpHandle);
 
     QFileInfo fileInfo(QString::fromStdString(path));
     _name = fileInfo.baseName().toStdString();
+    _path = path;
 
     _bounds = Rect<double>(_shpHandle->adBoundsMin, _shpHandle->adBoundsMax);
 
@@ -181,12 +485,138 @@ Dataset::ShapeDatasetShared::RC::RC(std::string const& path)
     }
 }
 
+void Dataset::ShapeDatasetShared::RC::loadOrBuildIndex(std::string const& path, bool persistent)
+{
+    // The index is stale as soon as the .shp changes in size or modification time.
+    QFileInfo shpInfo(QString::fromStdString(path));
+    std::string indexPath = (shpInfo.path() + "/" + shpInfo.completeBaseName() + ".sqt").toStdString();
+    double sourceSize = double(shpInfo.size());
+    double sourceTime = double(shpInfo.lastModified().toMSecsSinceEpoch());
+
+    if (persistent)
+    {
+        _diskTree = SHPOpenDiskTree(indexPath.c_str(), _shpHandle->nRecords, sourceSize, sourceTime);
+        if (_diskTree)
+        {
+            // The record bounds are not persisted, they only take a pass over the record headers.
+            scanRecords(scanThreadCount(), [this](int, int first, int last)
+            {
+                double boundsMin[2], boundsMax[2];
+                for (int index = first; index < last; ++index)
+                    loadRecordBounds(index, boundsMin, boundsMax);
+            });
+            return;
+        }
+    }
+
+    _shpTree = buildTree();
+    SHPTreeTrimExtraNodes(_shpTree);
+
+    // Query the mapped copy from now on, the in-memory tree is only
+    // kept if the directory is not writable.
+    if (persistent && SHPWriteDiskTree(_shpTree, indexPath.c_str(), sourceSize, sourceTime))
+    {
+        _diskTree = SHPOpenDiskTree(indexPath.c_str(), _shpHandle->nRecords, sourceSize, sourceTime);
+        if (_diskTree)
+        {
+            SHPDestroyTree(_shpTree);
+            _shpTree = nullptr;
+        }
+    }
+}
+
+SHPTree* Dataset::ShapeDatasetShared::RC::buildTree()
+{
+    // The tree only needs each record's box, which SHPReadObjectBounds() takes
+    // from the record header without decoding any vertices. Each thread fills
+    // its own tree over the same root bounds and the trees are merged at the end.
+    int threadCount = scanThreadCount();
+
+    std::vector<SHPTree*> trees(threadCount);
+    for (auto& tree : trees)
+        tree = SHPCreateTree(nullptr, 2, 10, _shpHandle->adBoundsMin, _shpHandle->adBoundsMax);
+
+    scanRecords(threadCount, [this, &trees](int threadIndex, int first, int last)
+    {
+        double boundsMin[2], boundsMax[2];
+        for (int index = first; index < last; ++index)
+            if (loadRecordBounds(index, boundsMin, boundsMax))
+                SHPTreeAddShapeBounds(trees[threadIndex], index, boundsMin, boundsMax);
+    });
+
+    for (int i = 1; i < threadCount; ++i)
+        SHPTreeMerge(trees[0], trees[i]);
+
+    trees[0]->hSHP = _shpHandle;
+    return trees[0];
+}
+
+int Dataset::ShapeDatasetShared::RC::scanThreadCount() const
+{
+    int const minRecordsPerThread = 16384;
+
+    int threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+    if (_maxScanThreads > 0)
+        threadCount = std::min(threadCount, _maxScanThreads);
+
+    return std::min(threadCount, std::max(1, _shpHandle->nRecords / minRecordsPerThread));
+}
+
+// Split the records into one contiguous range per thread and call
+// scanRange(threadIndex, first, last) for each, the first range on this thread.
+template<typename ScanRange>
+void Dataset::ShapeDatasetShared::RC::scanRecords(int threadCount, ScanRange scanRange)
+{
+    int recordCount = _shpHandle->nRecords;
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; ++i)
+        workers.emplace_back(scanRange, i,
+                             int(recordCount * (long long)i / threadCount),
+                             int(recordCount * (long long)(i + 1) / threadCount));
+
+    scanRange(0, 0, int(recordCount / threadCount));
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+bool Dataset::ShapeDatasetShared::RC::loadRecordBounds(int index, double* boundsMin, double* boundsMax)
+{
+    float const infinity = std::numeric_limits<float>::infinity();
+
+    if (!SHPReadObjectBounds(_shpHandle, index, boundsMin, boundsMax))
+    {
+        _recordXMin[index] = _recordYMin[index] = infinity;
+        _recordXMax[index] = _recordYMax[index] = -infinity;
+        return false;
+    }
+
+    _recordXMin[index] = roundDown(boundsMin[0]);
+    _recordYMin[index] = roundDown(boundsMin[1]);
+    _recordXMax[index] = roundUp(boundsMax[0]);
+    _recordYMax[index] = roundUp(boundsMax[1]);
+    return true;
+}
+
 Rect<double> const& Graphics::Shape::bounds() const
 {
     return _private->_ptrDataset->bounds();
 }
+
+Dataset::ShapeDatasetShared const& Graphics::Shape::dataset() const
+{
+    return _private->_ptrDataset;
+}
+
 Dataset::ShapeDatasetShared::RC::~RC()
 {
+    // The build reads the handle and the resident copy. A job not started yet is
+    // taken back from the pool, one running is waited for.
+    _lodPyramidCancel = true;
+    if (_lodPyramidJob && !QThreadPool::globalInstance()->tryTake(_lodPyramidJob.get()))
+        _lodPyramidBuilt.wait();
+
     if(_shpHandle)
     {
         SHPClose(_shpHandle);
@@ -198,6 +628,12 @@ Dataset::ShapeDatasetShared::RC::~RC()
         SHPDestroyTree(_shpTree);
         _shpTree = nullptr;
     }
+
+    if(_diskTree)
+    {
+        SHPCloseDiskTree(_diskTree);
+        _diskTree = nullptr;
+    }
 }
 
 Dataset::ShapeDatasetShared::RC* Dataset::ShapeDatasetShared::RC::addRef()
@@ -206,9 +642,9 @@ Dataset::ShapeDatasetShared::RC* Dataset::ShapeDatasetShared::RC::addRef()
     return this;
 }
 
-Dataset::ShapeDatasetShared::ShapeDatasetShared(std::string const& path)
+Dataset::ShapeDatasetShared::ShapeDatasetShared(std::string const& path, OpenOptions const& options)
 {
-    _raw = new RC(path);
+    _raw = new RC(path, options);
 }
 
 Dataset::ShapeDatasetShared::ShapeDatasetShared(RC* shapeDataset)
@@ -216,21 +652,25 @@ Dataset::ShapeDatasetShared::ShapeDatasetShared(RC* shapeDataset)
 
 
 Dataset::ShapeDatasetShared::ShapeDatasetShared(ShapeDatasetShared const& rhs)
-    : _raw(rhs._raw->addRef()) {}
+    : _raw(rhs._raw ? rhs._raw->addRef() : nullptr) {}
 
 Dataset::ShapeDatasetShared& Dataset::ShapeDatasetShared::operator= (ShapeDatasetShared const& rhs)
 {
     if(this == &rhs)
         return *this;
 
-    if(--_raw->_refCount == 0)
-        delete _raw;
+    release();
 
-    _raw = rhs._raw->addRef();
+    _raw = rhs._raw ? rhs._raw->addRef() : nullptr;
 
     return *this;
 }
 
+int Dataset::ShapeDatasetShared::useCount() const
+{
+    return _raw ? int(_raw->_refCount) : 0;
+}
+
 //ShapeDatasetShared::ShapeDatasetShared(ShapeDatasetShared const& rhs)
 //    : _raw(rhs._raw)
 //{
@@ -253,25 +693,238 @@ Dataset::ShapeDatasetShared& Dataset::ShapeDatasetShared::operator= (ShapeDatase
 
 Dataset::ShapeDatasetShared::~ShapeDatasetShared()
 {
-    if(_raw && --_raw->_refCount == 0)
+    release();
+}
+
+// A layer removed, cleared or restyled away may leave the registry the only
+// holder, which then closes what is over its budget. Whether the dataset is
+// registered is read before the decrement, after it the registry may delete it.
+void Dataset::ShapeDatasetShared::release()
+{
+    if(!_raw)
+        return;
+
+    bool registered = _raw->_registered;
+    int useCount = --_raw->_refCount;
+    if(useCount == 0)
         delete _raw;
+    else if(useCount == 1 && registered)
+        DatasetRegistry::instance().trim();
+
+    _raw = nullptr;
 }
 
-std::vector<int> const Dataset::ShapeDatasetShared::RC::filterRecords(Rect<double> const& mapHitBounds) const
+Dataset::PackedRTree const& Dataset::ShapeDatasetShared::RC::packedRTree() const
 {
-    double mapHitBoundsMin[2] = {mapHitBounds.xMin(), mapHitBounds.yMin()};
-    double mapHitBoundsMax[2] = {mapHitBounds.xMax(), mapHitBounds.yMax()};
+    std::call_once(_packedRTreeBuilt, [this]()
+    {
+        std::vector<PackedRTree::Entry> leaves;
+        leaves.reserve(_shpHandle->nRecords);
 
-    int hitCount;
-    int* recordsHitArray = SHPTreeFindLikelyShapes(_shpTree, mapHitBoundsMin, mapHitBoundsMax, &hitCount);
+        double boundsMin[2], boundsMax[2];
+        for (int index = 0; index < _shpHandle->nRecords; ++index)
+            if (SHPReadObjectBounds(_shpHandle, index, boundsMin, boundsMax))
+                leaves.push_back({boundsMin[0], boundsMin[1], boundsMax[0], boundsMax[1], index, 0});
 
-    std::vector<int> recordsHit;
-    for (int i = 0; i < hitCount; ++i)
-        recordsHit.push_back(recordsHitArray[i]);
+        _packedRTree = PackedRTree(std::move(leaves));
+        _packedRTreeReady = true;
+    });
+
+    return _packedRTree;
+}
+
+// Runs a build on a pool thread. The dataset owns the job, whose future tells
+// when it is done with the dataset.
+class LodPyramidJob : public QRunnable
+{
+public:
+    explicit LodPyramidJob(std::function<void()> const& build) : _build(build) { setAutoDelete(false); }
+
+    virtual void run() override
+    {
+        _build();
+        _built.set_value();
+    }
+
+    std::future<void> built() { return _built.get_future(); }
+
+private:
+    std::function<void()> _build;
+    std::promise<void> _built;
+};
+
+// Building reads and simplifies every record, far too long to hold up a draw.
+void Dataset::ShapeDatasetShared::RC::buildLodPyramid() const
+{
+    std::call_once(_lodPyramidStarted, [this]()
+    {
+        if (_type != ShapeType::Polyline && _type != ShapeType::Polygon)
+            return;
+
+        LodPyramidJob* job = new LodPyramidJob([this]()
+        {
+            if (_lodPyramidCancel)
+                return;
+
+            LodPyramid pyramid = _resident ? LodPyramid(_residentGeometry, _bounds, &_lodPyramidCancel)
+                                           : LodPyramid(_shpHandle, &_lodPyramidCancel);
+            if (_lodPyramidCancel)
+                return;
+
+            _lodPyramid = std::move(pyramid);
+            _lodPyramidReady = true;
+        });
+
+        _lodPyramidBuilt = job->built();
+        _lodPyramidJob.reset(job);
+        QThreadPool::globalInstance()->start(job);
+    });
+}
+
+Dataset::AttributeColumns const& Dataset::ShapeDatasetShared::RC::attributes() const
+{
+    std::call_once(_attributesOpened, [this]()
+    {
+        _attributes.reset(new AttributeColumns(_path));
+        _attributesReady = true;
+    });
+
+    return *_attributes;
+}
+
+std::size_t Dataset::ShapeDatasetShared::RC::memoryUsage() const
+{
+    std::size_t usage = (_recordXMin.capacity() + _recordYMin.capacity()
+                         + _recordXMax.capacity() + _recordYMax.capacity()) * sizeof(float);
+
+    if (_shpHandle)
+        usage += std::size_t(_shpHandle->nMaxRecords) * 2 * sizeof(int);
+
+    if (_packedRTreeReady)
+        usage += _packedRTree.memoryUsage();
+
+    if (_lodPyramidReady)
+        usage += _lodPyramid.memoryUsage();
 
+    return usage + _residentGeometry.memoryUsage() + attributesMemoryUsage();
+}
+
+std::vector<int> const Dataset::ShapeDatasetShared::RC::filterRecords(Rect<double> const& mapHitBounds) const
+{
+    return filterRecords(mapHitBounds, _indexType);
+}
+
+std::vector<int> const Dataset::ShapeDatasetShared::RC::filterRecords(Rect<double> const& mapHitBounds,
+                                                                      IndexType indexType) const
+{
+    std::vector<int> recordsHit;
+    filterRecords(mapHitBounds, indexType, recordsHit);
     return recordsHit;
 }
 
+// Append the shapeids of one quadtree node to the std::vector<int> passed as user data.
+static void appendShapeIds(int const* shapeIds, int shapeCount, void* recordsHit)
+{
+    auto& records = *static_cast<std::vector<int>*>(recordsHit);
+    records.insert(records.end(), shapeIds, shapeIds + shapeCount);
+}
+
+void Dataset::ShapeDatasetShared::RC::filterRecords(Rect<double> const& mapHitBounds, IndexType indexType,
+                                                    std::vector<int>& recordsHit) const
+{
+    recordsHit.clear();
+
+    if (indexType == IndexType::PackedRTree)
+    {
+        packedRTree().visit(mapHitBounds, [&recordsHit](int recordId) { recordsHit.push_back(recordId); });
+    }
+    else
+    {
+        double mapHitBoundsMin[2] = {mapHitBounds.xMin(), mapHitBounds.yMin()};
+        double mapHitBoundsMax[2] = {mapHitBounds.xMax(), mapHitBounds.yMax()};
+
+        if (_diskTree)
+            SHPDiskTreeVisitLikelyShapes(_diskTree, mapHitBoundsMin, mapHitBoundsMax, appendShapeIds, &recordsHit);
+        else
+            SHPTreeVisitLikelyShapes(_shpTree, mapHitBoundsMin, mapHitBoundsMax, appendShapeIds, &recordsHit);
+    }
+
+    // Ascending ids keep the record reads as sequential as possible.
+    std::sort(recordsHit.begin(), recordsHit.end());
+}
+
+void Dataset::ShapeDatasetShared::RC::refineRecords(Rect<double> const& mapHitBounds, std::vector<int>& recordsHit) const
+{
+    // Round the box outwards as well, so a float comparison can only keep too much, never too little.
+    float const xMin = roundDown(mapHitBounds.xMin()), yMin = roundDown(mapHitBounds.yMin());
+    float const xMax = roundUp(mapHitBounds.xMax()), yMax = roundUp(mapHitBounds.yMax());
+
+    std::size_t const candidateCount = recordsHit.size();
+    std::size_t keptCount = 0;
+    std::size_t i = 0;
+
+#ifdef CL_HAVE_SSE2
+    // Four candidates per step: the bounds are gathered into lanes,
+    // compared at once, and the survivors compacted in order.
+    __m128 const boxXMin = _mm_set1_ps(xMin), boxYMin = _mm_set1_ps(yMin);
+    __m128 const boxXMax = _mm_set1_ps(xMax), boxYMax = _mm_set1_ps(yMax);
+
+    for (; i + 4 <= candidateCount; i += 4)
+    {
+        int const ids[4] = {recordsHit[i], recordsHit[i + 1], recordsHit[i + 2], recordsHit[i + 3]};
+
+        __m128 recordXMin = _mm_setr_ps(_recordXMin[ids[0]], _recordXMin[ids[1]], _recordXMin[ids[2]], _recordXMin[ids[3]]);
+        __m128 recordYMin = _mm_setr_ps(_recordYMin[ids[0]], _recordYMin[ids[1]], _recordYMin[ids[2]], _recordYMin[ids[3]]);
+        __m128 recordXMax = _mm_setr_ps(_recordXMax[ids[0]], _recordXMax[ids[1]], _recordXMax[ids[2]], _recordXMax[ids[3]]);
+        __m128 recordYMax = _mm_setr_ps(_recordYMax[ids[0]], _recordYMax[ids[1]], _recordYMax[ids[2]], _recordYMax[ids[3]]);
+
+        __m128 miss = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(recordXMax, boxXMin), _mm_cmpgt_ps(recordXMin, boxXMax)),
+                                _mm_or_ps(_mm_cmplt_ps(recordYMax, boxYMin), _mm_cmpgt_ps(recordYMin, boxYMax)));
+        int missMask = _mm_movemask_ps(miss);
+
+        for (int lane = 0; lane < 4; ++lane)
+            if ((missMask & (1 << lane)) == 0)
+                recordsHit[keptCount++] = ids[lane];
+    }
+#endif
+
+    for (; i < candidateCount; ++i)
+    {
+        int id = recordsHit[i];
+        if (_recordXMax[id] < xMin || _recordXMin[id] > xMax || _recordYMax[id] < yMin || _recordYMin[id] > yMax)
+            continue;
+        recordsHit[keptCount++] = id;
+    }
+
+    recordsHit.resize(keptCount);
+}
+
+void Dataset::ShapeDatasetShared::RC::cullSubPixelRecords(float scaleToDisplay, std::vector<int>& recordsHit,
+                                                          std::vector<int>& subPixelRecords) const
+{
+    // The bounds are rounded outwards, so a record near a pixel in size may be kept but never culled wrongly.
+    float const pixelSize = 1.0f / scaleToDisplay;
+
+    subPixelRecords.clear();
+    std::size_t keptCount = 0;
+
+    for (auto id : recordsHit)
+    {
+        if (_recordXMax[id] - _recordXMin[id] < pixelSize && _recordYMax[id] - _recordYMin[id] < pixelSize)
+            subPixelRecords.push_back(id);
+        else
+            recordsHit[keptCount++] = id;
+    }
+
+    recordsHit.resize(keptCount);
+}
+
+Pair<double> Dataset::ShapeDatasetShared::RC::recordCenter(int index) const
+{
+    return Pair<double>((double(_recordXMin[index]) + _recordXMax[index]) * 0.5,
+                        (double(_recordYMin[index]) + _recordYMax[index]) * 0.5);
+}
+
 Dataset::ShapeRecordUnique::~ShapeRecordUnique()
 {
     if(_raw)
@@ -279,7 +932,7 @@ Dataset::ShapeRecordUnique::~ShapeRecordUnique()
 }
 
 Dataset::ShapeRecordUnique::ShapeRecordUnique(ShapeDatasetShared const& ptrDataset, int index)
-    : _raw(SHPReadObject(ptrDataset->handle(), index)) {}
+    : _raw(SHPReadObjectR(ptrDataset->handle(), index, &threadReadContext.context)) {}
 
 Dataset::ShapeRecordUnique::ShapeRecordUnique(ShapeRecordUnique&& rhs)
 {
@@ -299,26 +952,157 @@ Dataset::ShapeRecordUnique Dataset::ShapeDatasetShared::readRecord(int index) co
     return ShapeRecordUnique(*this, index);
 }
 
+Dataset::ShapeRecordView Dataset::ShapeDatasetShared::viewRecord(int index) const
+{
+    return ShapeRecordView(*this, index);
+}
+
+Dataset::ShapeRecordView::ShapeRecordView(ShapeDatasetShared const& ptrDataset, int index)
+    : ShapeRecordView(ptrDataset->handle(), index) {}
+
+Dataset::ShapeRecordView::ShapeRecordView(SHPHandle shpHandle, int index)
+    : _bytes(nullptr), _partStarts(nullptr), _points(nullptr), _partCount(0), _vertexCount(0)
+{
+    int size = 0;
+    unsigned char const* bytes = SHPReadRecordBytesR(shpHandle, index, &threadReadContext.context, &size);
+
+    // The 8-byte record header is followed by the shape type.
+    if (bytes == nullptr || size < 12)
+        return;
+
+    _bytes = bytes;
+
+    // Every count read from the record is checked against its size,
+    // a truncated or corrupt record is treated as an empty one.
+    switch (shapeType())
+    {
+    case SHPT_POINT:
+    case SHPT_POINTZ:
+    case SHPT_POINTM:
+        if (size >= 28)
+        {
+            _points = bytes + 12;
+            _vertexCount = 1;
+        }
+        break;
+
+    case SHPT_MULTIPOINT:
+    case SHPT_MULTIPOINTZ:
+    case SHPT_MULTIPOINTM:
+    {
+        if (size < 48)
+            break;
+
+        int pointCount = readLittleEndian<int>(bytes + 44);
+        if (pointCount >= 0 && 48 + 16LL * pointCount <= size)
+        {
+            _points = bytes + 48;
+            _vertexCount = pointCount;
+        }
+        break;
+    }
+
+    case SHPT_ARC:
+    case SHPT_ARCZ:
+    case SHPT_ARCM:
+    case SHPT_POLYGON:
+    case SHPT_POLYGONZ:
+    case SHPT_POLYGONM:
+    case SHPT_MULTIPATCH:
+    {
+        if (size < 52)
+            break;
+
+        int partCount = readLittleEndian<int>(bytes + 44);
+        int pointCount = readLittleEndian<int>(bytes + 48);
+
+        // A multipatch also stores one part type per part before the points.
+        long long partBytes = 4LL * partCount * (shapeType() == SHPT_MULTIPATCH ? 2 : 1);
+        if (partCount < 0 || pointCount < 0 || 52 + partBytes + 16LL * pointCount > size)
+            break;
+
+        _partStarts = bytes + 52;
+        _points = bytes + 52 + partBytes;
+        _partCount = partCount;
+        _vertexCount = pointCount;
+
+        for (int partIndex = 0; partIndex < partCount; ++partIndex)
+            if (partStart(partIndex) < 0 || partStart(partIndex) > partStart(partIndex + 1))
+            {
+                _partCount = _vertexCount = 0;
+                break;
+            }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
 std::shared_ptr<Graphics::Shape> Graphics::Shape::clone() const
 {
     Dataset::ShapeDatasetShared datasetCopy = _private->_ptrDataset;
+    std::shared_ptr<Graphics::Shape> shapeCopy;
 
     switch (datasetCopy->type())
     {
     case Dataset::ShapeType::Point:
-        return std::shared_ptr<Graphics::Shape>(new Graphics::Point(datasetCopy));
+        shapeCopy.reset(new Graphics::Point(datasetCopy));
         break;
 
     case Dataset::ShapeType::Polyline:
-        return std::shared_ptr<Graphics::Shape>(new Graphics::Polyline(datasetCopy));
+        shapeCopy.reset(new Graphics::Polyline(datasetCopy));
         break;
 
     case Dataset::ShapeType::Polygon:
-        return std::shared_ptr<Graphics::Shape>(new Graphics::Polygon(datasetCopy));
+        shapeCopy.reset(new Graphics::Polygon(datasetCopy));
         break;
 
     default:
         return nullptr;
         break;
     }
+
+    shapeCopy->_private->_thematicStyle = _private->_thematicStyle;
+    shapeCopy->_private->_attributeFilter = _private->_attributeFilter;
+    return shapeCopy;
+}
+
+std::shared_ptr<Graphics::Shape> Graphics::Shape::recoloredClone() const
+{
+    std::shared_ptr<Shape> shapeCopy = clone();
+    if (!shapeCopy)
+        return nullptr;
+
+    // The copy keeps the colors of the layer, drawn again once a style is cleared.
+    shapeCopy->_private->_borderColor = _private->_borderColor;
+    shapeCopy->_private->_fillColor = _private->_fillColor;
+    return shapeCopy;
+}
+
+std::shared_ptr<Graphics::ThematicStyle const> const& Graphics::Shape::thematicStyle() const
+{
+    return _private->_thematicStyle;
+}
+
+std::shared_ptr<Graphics::Shape> Graphics::Shape::restyled(std::shared_ptr<ThematicStyle const> const& style) const
+{
+    std::shared_ptr<Shape> shapeCopy = recoloredClone();
+    if (shapeCopy)
+        shapeCopy->_private->_thematicStyle = style;
+    return shapeCopy;
+}
+
+std::shared_ptr<Dataset::AttributeFilter const> const& Graphics::Shape::attributeFilter() const
+{
+    return _private->_attributeFilter;
+}
+
+std::shared_ptr<Graphics::Shape> Graphics::Shape::filtered(std::shared_ptr<Dataset::AttributeFilter const> const& filter) const
+{
+    std::shared_ptr<Shape> shapeCopy = recoloredClone();
+    if (shapeCopy)
+        shapeCopy->_private->_attributeFilter = filter;
+    return shapeCopy;
 }
@@ -4,11 +4,19 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <future>
 #include "../shapelib/shapefil.h"
 #include "nsdef.h"
 #include "support.h"
+#include "packedrtree.h"
+#include "lodpyramid.h"
+#include "geometrystore.h"
+#include "attributecolumns.h"
 
 class QPainter;
+class QRunnable;
 class QPoint;
 class QColor;
 
@@ -20,6 +28,34 @@ enum class cl::Dataset::ShapeType
     Polygon
 };
 
+enum class cl::Dataset::AccessMode
+{
+    Buffered = 0, // Records are read through stdio into a shared buffer.
+    Mapped        // The .shp/.shx stay memory-mapped and records are decoded in place.
+};
+
+enum class cl::Dataset::IndexType
+{
+    QuadTree = 0, // The shapelib quadtree, persisted as .sqt.
+    PackedRTree   // A packed R-tree built in memory, exact on the record boxes.
+};
+
+struct cl::Dataset::OpenOptions
+{
+    AccessMode accessMode = AccessMode::Mapped;
+    IndexType indexType = IndexType::QuadTree;
+
+    // Keep the spatial index in a .sqt file next to the .shp and map it on later opens.
+    bool persistentIndex = true;
+
+    // Decode every record into memory at open, drawing then reads nothing from the file.
+    bool resident = false;
+
+    // The most threads scanning the records at open, zero for one per hardware thread.
+    // Lowered when several files are opened at once, each on a thread of its own.
+    int maxScanThreads = 0;
+};
+
 class cl::Dataset::ShapeRecordUnique
 {
 public:
@@ -46,6 +82,57 @@ private:
     SHPObject* _raw;
 };
 
+// The x/y pairs of a record, interleaved and little-endian as stored in the file.
+class cl::Dataset::PointSpan
+{
+public:
+    PointSpan() : _bytes(nullptr), _count(0) {}
+    PointSpan(unsigned char const* bytes, int count) : _bytes(bytes), _count(count) {}
+
+    int size() const { return _count; }
+    double x(int index) const { return readLittleEndian<double>(_bytes + 16 * index); }
+    double y(int index) const { return readLittleEndian<double>(_bytes + 16 * index + 8); }
+
+    PointSpan subspan(int first, int count) const { return PointSpan(_bytes + 16 * first, count); }
+    unsigned char const* bytes() const { return _bytes; }
+
+private:
+    unsigned char const* _bytes;
+    int _count;
+};
+
+// A non-owning view over the raw bytes of one record, nothing is allocated or copied.
+// For a mapped dataset it stays valid as long as the dataset does,
+// otherwise only until the same thread reads its next record from any dataset.
+class cl::Dataset::ShapeRecordView
+{
+public:
+    ShapeRecordView() : _bytes(nullptr), _partCount(0), _vertexCount(0) {}
+    ShapeRecordView(ShapeDatasetShared const& ptrDataset, int index);
+    ShapeRecordView(SHPHandle shpHandle, int index);
+
+    bool isNull() const { return _bytes == nullptr; }
+    int shapeType() const { return _bytes ? readLittleEndian<int>(_bytes + 8) : SHPT_NULL; }
+
+    int partCount() const { return _partCount; }
+    int vertexCount() const { return _vertexCount; }
+
+    // The part offsets into points(), partStart(partCount()) equals vertexCount().
+    int partStart(int partIndex) const
+    { return partIndex < _partCount ? readLittleEndian<int>(_partStarts + 4 * partIndex) : _vertexCount; }
+
+    PointSpan points() const { return PointSpan(_points, _vertexCount); }
+    PointSpan partPoints(int partIndex) const
+    { return points().subspan(partStart(partIndex), partStart(partIndex + 1) - partStart(partIndex)); }
+
+private:
+    unsigned char const* _bytes;
+    unsigned char const* _partStarts;
+    unsigned char const* _points;
+    int _partCount;
+    int _vertexCount;
+};
+
 class cl::Dataset::ShapeDatasetShared
 {
 private:
@@ -54,7 +141,7 @@ private:
 
 public:
     ShapeDatasetShared() : _raw(nullptr) {}
-    ShapeDatasetShared(std::string const& path);
+    ShapeDatasetShared(std::string const& path, OpenOptions const& options = OpenOptions());
     ShapeDatasetShared(RC* shapeDataset);
 
     ShapeDatasetShared(ShapeDatasetShared const& rhs);
@@ -68,37 +155,140 @@ public:
     bool operator== (void* that) const { return _raw == that ? true : false; }
     bool operator!= (void* that) const { return _raw != that ? true : false; }
 
+    // How many copies share the dataset, zero for an empty one.
+    int useCount() const;
+
     ShapeRecordUnique readRecord(int index) const;
+    ShapeRecordView viewRecord(int index) const;
+
+private:
+    void release();
 };
 
 class cl::Dataset::ShapeDatasetShared::RC
 {
     friend class ShapeDatasetShared;
+    friend class DatasetRegistry;
 
 public:
     ~RC();
 
     ShapeType type() const { return _type; }
     SHPHandle const& handle() const { return _shpHandle; }
-    SHPTree const& tree() const { return *_shpTree; }
     int recordCount() const { return _shpHandle->nRecords;}
     Rect<double> const& bounds() const { return _bounds; }
     std::string const& name() const { return _name; }
+    std::string const& path() const { return _path; }
     std::vector<int> const filterRecords(Rect<double> const& mapHitBounds) const;
+    std::vector<int> const filterRecords(Rect<double> const& mapHitBounds, IndexType indexType) const;
+
+    // Fill recordsHit with the candidate ids in ascending order. The buffer is
+    // cleared but keeps its capacity, so a reused buffer costs no allocation.
+    void filterRecords(Rect<double> const& mapHitBounds, IndexType indexType, std::vector<int>& recordsHit) const;
+
+    IndexType indexType() const { return _indexType; }
+
+    // Built on first use unless the dataset was opened with IndexType::PackedRTree.
+    PackedRTree const& packedRTree() const;
+
+    // Start building the pyramid on the global thread pool, unless it was started before.
+    // It stays empty unless the records are polylines or polygons.
+    void buildLodPyramid() const;
+
+    // The pyramid once built, nullptr until then.
+    LodPyramid const* lodPyramid() const { return _lodPyramidReady ? &_lodPyramid : nullptr; }
+
+    // Every record decoded at open, only if opened resident.
+    bool isResident() const { return _resident; }
+    GeometryStore const& residentGeometry() const { return _residentGeometry; }
+
+    // The .dbf as typed columns, opened on first use and every column parsed on its own first use.
+    AttributeColumns const& attributes() const;
+    std::size_t attributesMemoryUsage() const { return _attributesReady ? _attributes->memoryUsage() : 0; }
+
+    // The bytes held for the record table and bounds, the packed R-tree, the pyramid,
+    // the resident geometry and the attribute columns parsed so far.
+    std::size_t memoryUsage() const;
+
+    // Drop the candidates whose own bounds miss the box, keeping the order of the rest.
+    void refineRecords(Rect<double> const& mapHitBounds, std::vector<int>& recordsHit) const;
+
+    // Move the records whose bounds are under a pixel both ways at this scale
+    // from recordsHit to subPixelRecords, keeping the order of both.
+    void cullSubPixelRecords(float scaleToDisplay, std::vector<int>& recordsHit, std::vector<int>& subPixelRecords) const;
+    Pair<double> recordCenter(int index) const;
 
 private:
-    RC(std::string const& path);
+    RC(std::string const& path, OpenOptions const& options);
+
+    void loadOrBuildIndex(std::string const& path, bool persistent);
+    SHPTree* buildTree();
+
+    int scanThreadCount() const;
+    template<typename ScanRange>
+    void scanRecords(int threadCount, ScanRange scanRange);
+    bool loadRecordBounds(int index, double* boundsMin, double* boundsMax);
 
     SHPInfo* _shpHandle;
-    SHPTree* _shpTree;
+    SHPTree* _shpTree;          // Only kept if the index could not be persisted.
+    SHPDiskTree* _diskTree;
+    IndexType _indexType;
+    int _maxScanThreads;
+    mutable PackedRTree _packedRTree;
+    mutable std::once_flag _packedRTreeBuilt;
+    mutable std::atomic<bool> _packedRTreeReady; // Set once built, memoryUsage() may run on another thread.
+    mutable LodPyramid _lodPyramid;
+    mutable std::once_flag _lodPyramidStarted;
+    mutable std::unique_ptr<QRunnable> _lodPyramidJob;
+    mutable std::future<void> _lodPyramidBuilt; // Ready once the job has run, cancelled or not.
+    mutable std::atomic<bool> _lodPyramidCancel; // Raised when the dataset is closed before the build is done.
+    mutable std::atomic<bool> _lodPyramidReady;  // Set once built, read by draws and memoryUsage() on other threads.
+    bool _resident;
+    GeometryStore _residentGeometry;
+    mutable std::unique_ptr<AttributeColumns> _attributes;
+    mutable std::once_flag _attributesOpened;
+    mutable std::atomic<bool> _attributesReady;
+
+    // The bounds of every record as floats, rounded outwards so that testing
+    // against them never rejects an intersecting record. A null record has an empty box.
+    std::vector<float> _recordXMin, _recordYMin, _recordXMax, _recordYMax;
+
     ShapeType _type;
     std::string _name;
+    std::string _path;
     Rect<double> _bounds;
-    int _refCount;
+    std::atomic<int> _refCount; // Copies are released from the render thread as well.
+    std::atomic<bool> _registered; // Kept by the DatasetRegistry, told when its copy is the last.
 
     RC* addRef();
 };
 
+// What one draw went through, shown in the status bar.
+struct cl::Graphics::DrawStats
+{
+    int candidateCount = 0; // Records returned by the spatial index.
+    int filteredCount = 0;  // Candidates left out by the layers' definition queries, never read.
+    int hitCount = 0;       // Records whose own bounds intersect the view, the only ones read.
+    int tilesCached = 0;    // Tiles blitted from the tile cache.
+    int tilesRendered = 0;  // Tiles drawn and added to it.
+    int inputVertexCount = 0;   // Vertices transformed onto the display.
+    int emittedVertexCount = 0; // Vertices left for QPainter after decimation.
+    int subPixelCount = 0;      // Hits within a pixel, drawn from their bounds alone.
+
+    DrawStats& operator+= (DrawStats const& other)
+    {
+        candidateCount += other.candidateCount;
+        filteredCount += other.filteredCount;
+        hitCount += other.hitCount;
+        tilesCached += other.tilesCached;
+        tilesRendered += other.tilesRendered;
+        inputVertexCount += other.inputVertexCount;
+        emittedVertexCount += other.emittedVertexCount;
+        subPixelCount += other.subPixelCount;
+        return *this;
+    }
+};
+
 class cl::Graphics::Shape
 {
 public:
@@ -108,23 +298,45 @@ public:
     std::string const& name() const;
     int recordCount() const;
     Rect<double> const& bounds() const;
+    Dataset::ShapeDatasetShared const& dataset() const;
+
+    // The style the layer is drawn with, nullptr for its own colors.
+    std::shared_ptr<ThematicStyle const> const& thematicStyle() const;
+
+    // A copy of the layer drawn with another style. Layers are shared with the
+    // render thread, so a layer is replaced by a restyled copy, never changed.
+    std::shared_ptr<Shape> restyled(std::shared_ptr<ThematicStyle const> const& style) const;
+
+    // The definition query that restricts the records drawn, nullptr for all of them.
+    std::shared_ptr<Dataset::AttributeFilter const> const& attributeFilter() const;
+    std::shared_ptr<Shape> filtered(std::shared_ptr<Dataset::AttributeFilter const> const& filter) const;
+
+    virtual DrawStats draw(QPainter& painter, GraphicAssistant const& assistant) const = 0;
 
-    // Return the number of records hit according to the index tree.
-    virtual int draw(QPainter& painter, GraphicAssistant const& assistant) const = 0;
+    // How many pixels a drawn record may reach beyond its bounds on the display,
+    // a marker's radius or the antialiased pen of an outline.
+    virtual int symbolExtent() const { return 1; }
 
 protected:
     Shape(Dataset::ShapeDatasetShared const& ptrDataset);
 
     class Private;
     std::unique_ptr<Private> _private;
+
+private:
+    // A clone drawn with the same colors.
+    std::shared_ptr<Shape> recoloredClone() const;
 };
 
 class cl::Graphics::Point : public Shape
 {
 public:
+    static int const MarkerRadius = 5;
+
     Point(Dataset::ShapeDatasetShared ptrDataset): Shape(ptrDataset) {}
     virtual ~Point() {}
-    virtual int draw(QPainter& painter, GraphicAssistant const& assistant) const override;
+    virtual DrawStats draw(QPainter& painter, GraphicAssistant const& assistant) const override;
+    virtual int symbolExtent() const override { return MarkerRadius + 1; } // The radius and the pen.
 };
 
 class cl::Graphics::MultiPartShape : public Shape
@@ -134,8 +346,21 @@ public:
     virtual ~MultiPartShape() {}
 
 protected:
-    virtual int draw(QPainter& painter, GraphicAssistant const& assistant) const override;
+    virtual DrawStats draw(QPainter& painter, GraphicAssistant const& assistant) const override;
     virtual void drawPart(QPainter& painter, QPoint const* points, int pointCount) const = 0;
+
+private:
+    // Decimate a part already on the display and draw what is left, a part
+    // within a single pixel is drawn as that pixel.
+    void drawOnDisplay(QPainter& painter, QPoint* points, int pointCount, DrawStats& stats) const;
+
+    // Draw one record from decoded geometry, a pyramid level or the resident copy.
+    void drawStored(QPainter& painter, GraphicAssistant const& assistant,
+                    Dataset::GeometryStore const& geometry, int recordId, DrawStats& stats) const;
+
+    // Draw records within a pixel from their bounds alone, as the document's sub-pixel mode says.
+    void drawSubPixelRecords(QPainter& painter, GraphicAssistant const& assistant,
+                             int const* records, int recordCount, QColor const& color) const;
 };
 
 class cl::Graphics::Polyline : public MultiPartShape
@@ -160,7 +385,8 @@ class cl::DataManagement::ShapeFactory
 {
 public:
     virtual ~ShapeFactory() = default;
-    virtual std::shared_ptr<Graphics::Shape> createShape(std::string const& path) const = 0;
+    virtual std::shared_ptr<Graphics::Shape> createShape(std::string const& path,
+                                                         Dataset::OpenOptions const& options = Dataset::OpenOptions()) const = 0;
 
 protected:
     ShapeFactory() = default;
@@ -170,7 +396,8 @@ class cl::DataManagement::ShapeFactoryEsri: ShapeFactory
 {
 public:
     virtual ~ShapeFactoryEsri() = default;
-    virtual std::shared_ptr<Graphics::Shape> createShape(std::string const& path) const override;
+    virtual std::shared_ptr<Graphics::Shape> createShape(std::string const& path,
+                                                         Dataset::OpenOptions const& options = Dataset::OpenOptions()) const override;
     static ShapeFactory const& instance();
 
 private:
@@ -2,8 +2,17 @@
 #include <QColor>
 #include <QTime>
 #include <QPoint>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
 #include "mainwindow.h"
 #include "shapedata.h"
+#ifdef CL_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 #define COVER 0.9
 #define EPS 1E-4
@@ -16,7 +25,7 @@ class cl::Graphics::GraphicAssistant::Private
 
 private:
     Private(GraphicAssistant& refThis, DataManagement::ShapeDoc const& refDoc)
-        : _refThis(refThis), _refDoc(refDoc) {}
+        : _refThis(refThis), _refDoc(refDoc), _cancelFlag(nullptr) {}
 
     GraphicAssistant& _refThis;
 
@@ -26,6 +35,8 @@ private:
     Pair<int> _displayOrigin;
     float _scaleToDisplay;
     Rect<int> _paintingRect;
+
+    std::atomic<bool> const* _cancelFlag;
 };
 
 QString DataManagement::ShapeDoc::drawAllLayers(QPainter& painter, Graphics::GraphicAssistant const& assistant) const
@@ -33,48 +44,131 @@ QString DataManagement::ShapeDoc::drawAllLayers(QPainter& painter, Graphics::Gra
     //    if (isEmpty())
     //        return;
 
-    int countRecordsHit = 0;
-    int countRecordsTotal = 0;
+    QElapsedTimer renderTimer;
+    renderTimer.start();
+
+    Graphics::DrawStats stats = drawLayers(painter, assistant);
+
+    return describeDraw(stats, renderTimer.elapsed());
+}
+
+Graphics::DrawStats DataManagement::ShapeDoc::drawLayers(QPainter& painter, Graphics::GraphicAssistant const& assistant) const
+{
+    Graphics::DrawStats stats;
     for (auto const& item : _layerList)
     {
-        countRecordsHit += item->draw(painter, assistant);
-        countRecordsTotal += item->recordCount();
+        if (assistant.isCancelled())
+            break;
+
+        stats += item->draw(painter, assistant);
     }
 
-    float percentageHit = countRecordsHit / (countRecordsTotal + EPS);
+    return stats;
+}
 
-    QString msgCountHit = "    Records Hit: " + QString::number(countRecordsHit);
+QString DataManagement::ShapeDoc::describeDraw(Graphics::DrawStats const& stats, qint64 renderTime) const
+{
+    int countRecordsTotal = 0;
+    for (auto const& item : _layerList)
+        countRecordsTotal += item->recordCount();
+
+    float percentageHit = stats.hitCount / (countRecordsTotal + EPS);
+
+    QString msgCountCandidate = "    Candidates: " + QString::number(stats.candidateCount);
+    QString msgCountHit = "    Records Hit: " + QString::number(stats.hitCount);
+
+    QString msgFiltered;
+    if (stats.filteredCount > 0)
+        msgFiltered = "    Filtered Out: " + QString::number(stats.filteredCount);
     QString msgCountTotal = "    Records Total: " + QString::number(countRecordsTotal);
     QString msgPercentage = "    Percentage Hit: " + QString::number(percentageHit*  100, 'g', 4) + "%";
+    QString msgRenderTime = "    Render Time: " + QString::number(renderTime) + " ms";
+
+    QString msgSubPixel;
+    if (stats.subPixelCount > 0)
+        msgSubPixel = "    Sub-pixel: " + QString::number(stats.subPixelCount);
 
-    return  msgCountHit + msgCountTotal + msgPercentage;
+    QString msgVertices = "    Vertices Drawn: " + QString::number(stats.emittedVertexCount)
+            + "/" + QString::number(stats.inputVertexCount);
+
+    QString msgTiles;
+    if (stats.tilesCached + stats.tilesRendered > 0)
+        msgTiles = "    Tiles Cached: " + QString::number(stats.tilesCached)
+                + "/" + QString::number(stats.tilesCached + stats.tilesRendered);
+
+    return  msgCountCandidate + msgFiltered + msgCountHit + msgCountTotal + msgPercentage + msgSubPixel + msgVertices + msgRenderTime + msgTiles;
 }
 
 bool DataManagement::ShapeDoc::addLayer(std::string const& path)
 {
-    std::shared_ptr<Graphics::Shape> shp = ShapeFactoryEsri::instance().createShape(path);
+    return addLayer(path, Dataset::OpenOptions());
+}
+
+bool DataManagement::ShapeDoc::addLayer(std::string const& path, Dataset::OpenOptions const& options)
+{
+    std::shared_ptr<Graphics::Shape> shp = ShapeFactoryEsri::instance().createShape(path, options);
     if (!shp)
         return false;
 
-    _layerList.push_back(shp);
-
+    addLayer(shp);
     return true;
 }
 
+void DataManagement::ShapeDoc::addLayer(std::shared_ptr<Graphics::Shape> const& layer)
+{
+    _layerList.push_back(layer);
+    ++_revision;
+}
+
 void DataManagement::ShapeDoc::removeLayer(LayerIterator layerItr)
 {
     _layerList.erase(layerItr);
+    ++_revision;
 }
 
 void DataManagement::ShapeDoc::rearrangeLayer(LayerIterator fromItr, LayerIterator toItr)
 {
     _layerList.insert(toItr, *fromItr);
     _layerList.erase(fromItr);
+    ++_revision;
 }
 
 void DataManagement::ShapeDoc::clearAllLayers()
 {
     _layerList.clear();
+    ++_revision;
+}
+
+void DataManagement::ShapeDoc::setThematicStyle(LayerIterator layerItr,
+                                                std::shared_ptr<Graphics::ThematicStyle const> const& style)
+{
+    // A frame may be drawing the layer as it is, it is replaced rather than changed.
+    std::shared_ptr<Graphics::Shape> restyled = (*layerItr)->restyled(style);
+    if (!restyled)
+        return;
+
+    *layerItr = restyled;
+    ++_revision;
+}
+
+void DataManagement::ShapeDoc::setAttributeFilter(LayerIterator layerItr,
+                                                  std::shared_ptr<Dataset::AttributeFilter const> const& filter)
+{
+    std::shared_ptr<Graphics::Shape> filtered = (*layerItr)->filtered(filter);
+    if (!filtered)
+        return;
+
+    *layerItr = filtered;
+    ++_revision;
+}
+
+void DataManagement::ShapeDoc::setSubPixelMode(Graphics::SubPixelMode subPixelMode)
+{
+    if (subPixelMode == _subPixelMode)
+        return;
+
+    _subPixelMode = subPixelMode;
+    ++_revision;
 }
 
 std::unique_ptr<DataManagement::ShapeView> DataManagement::ShapeView::_instance = nullptr;
@@ -100,6 +194,17 @@ Graphics::GraphicAssistant::GraphicAssistant(DataManagement::ShapeDoc const& ref
     : _private(std::unique_ptr<Private>
                (new Private(*this, refDoc))) {}
 
+Graphics::GraphicAssistant::GraphicAssistant(GraphicAssistant const& other, DataManagement::ShapeDoc const& refDoc)
+    : _private(std::unique_ptr<Private>
+               (new Private(*this, refDoc)))
+{
+    _private->_mapOrigin = other._private->_mapOrigin;
+    _private->_displayOrigin = other._private->_displayOrigin;
+    _private->_scaleToDisplay = other._private->_scaleToDisplay;
+    _private->_paintingRect = other._private->_paintingRect;
+    _private->_cancelFlag = other._private->_cancelFlag;
+}
+
 void Graphics::GraphicAssistant::setPaintingRect(Rect<int> const& paintingRect)
 {
     _private->_paintingRect = paintingRect;
@@ -112,6 +217,135 @@ Pair<int> Graphics::GraphicAssistant::computePointOnDisplay(SHPObject const& rec
     return displayXY;
 }
 
+Pair<int> Graphics::GraphicAssistant::computePointOnDisplay(Dataset::PointSpan const& points, int ptIndex) const
+{
+    Pair<double> mapXY(points.x(ptIndex), points.y(ptIndex));
+    Pair<int> displayXY = mapToDisplayXY(mapXY);
+    return displayXY;
+}
+
+// The kernels below repeat the operations of mapToDisplayXY() in the same order,
+// (map - origin) * (1, -1) * scale + displayOrigin in double and truncated to int,
+// so every lane rounds exactly as the scalar code does.
+void Graphics::GraphicAssistant::computePointsOnDisplay(Dataset::PointSpan const& points, QPoint* displayPoints) const
+{
+    int const count = points.size();
+    int i = 0;
+
+#ifdef CL_HAVE_SSE2
+    // One x/y pair per 128-bit lane, as the points are stored interleaved.
+    unsigned char const* bytes = points.bytes();
+    __m128d const mapOrigin = _mm_setr_pd(_private->_mapOrigin.x(), _private->_mapOrigin.y());
+    __m128d const flipY = _mm_setr_pd(1, -1);
+    __m128d const scale = _mm_set1_pd(_private->_scaleToDisplay);
+    __m128d const displayOrigin = _mm_setr_pd(_private->_displayOrigin.x(), _private->_displayOrigin.y());
+
+#ifdef __AVX__
+    __m256d const mapOrigin2 = _mm256_setr_pd(_private->_mapOrigin.x(), _private->_mapOrigin.y(),
+                                              _private->_mapOrigin.x(), _private->_mapOrigin.y());
+    __m256d const flipY2 = _mm256_setr_pd(1, -1, 1, -1);
+    __m256d const scale2 = _mm256_set1_pd(_private->_scaleToDisplay);
+    __m256d const displayOrigin2 = _mm256_setr_pd(_private->_displayOrigin.x(), _private->_displayOrigin.y(),
+                                                  _private->_displayOrigin.x(), _private->_displayOrigin.y());
+
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256d xy = _mm256_loadu_pd(reinterpret_cast<double const*>(bytes + 16 * i));
+        xy = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_sub_pd(xy, mapOrigin2), flipY2), scale2), displayOrigin2);
+        __m128i display = _mm256_cvttpd_epi32(xy);
+
+        displayPoints[i] = QPoint(_mm_cvtsi128_si32(display), _mm_cvtsi128_si32(_mm_srli_si128(display, 4)));
+        displayPoints[i + 1] = QPoint(_mm_cvtsi128_si32(_mm_srli_si128(display, 8)), _mm_cvtsi128_si32(_mm_srli_si128(display, 12)));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        __m128d xy = _mm_loadu_pd(reinterpret_cast<double const*>(bytes + 16 * i));
+        xy = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(_mm_sub_pd(xy, mapOrigin), flipY), scale), displayOrigin);
+        __m128i display = _mm_cvttpd_epi32(xy);
+
+        displayPoints[i] = QPoint(_mm_cvtsi128_si32(display), _mm_cvtsi128_si32(_mm_srli_si128(display, 4)));
+    }
+#endif
+
+    for (; i < count; ++i)
+        displayPoints[i] = computePointOnDisplay(points, i).toQPoint();
+}
+
+void Graphics::GraphicAssistant::computePointsOnDisplay(double const* xs, double const* ys, int count,
+                                                        QPoint* displayPoints) const
+{
+    int i = 0;
+
+#ifdef CL_HAVE_SSE2
+    // Two points per step, x and y in separate registers, then interleaved into x0, y0, x1, y1.
+    __m128d const mapOriginX = _mm_set1_pd(_private->_mapOrigin.x());
+    __m128d const mapOriginY = _mm_set1_pd(_private->_mapOrigin.y());
+    __m128d const flipY = _mm_set1_pd(-1);
+    __m128d const scale = _mm_set1_pd(_private->_scaleToDisplay);
+    __m128d const displayOriginX = _mm_set1_pd(_private->_displayOrigin.x());
+    __m128d const displayOriginY = _mm_set1_pd(_private->_displayOrigin.y());
+
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128d x = _mm_loadu_pd(xs + i);
+        __m128d y = _mm_loadu_pd(ys + i);
+
+        // Multiplying x by one is exact, so it is left out.
+        x = _mm_add_pd(_mm_mul_pd(_mm_sub_pd(x, mapOriginX), scale), displayOriginX);
+        y = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(_mm_sub_pd(y, mapOriginY), flipY), scale), displayOriginY);
+
+        __m128i display = _mm_unpacklo_epi32(_mm_cvttpd_epi32(x), _mm_cvttpd_epi32(y));
+
+        displayPoints[i] = QPoint(_mm_cvtsi128_si32(display), _mm_cvtsi128_si32(_mm_srli_si128(display, 4)));
+        displayPoints[i + 1] = QPoint(_mm_cvtsi128_si32(_mm_srli_si128(display, 8)), _mm_cvtsi128_si32(_mm_srli_si128(display, 12)));
+    }
+#endif
+
+    for (; i < count; ++i)
+        displayPoints[i] = mapToDisplayXY(Pair<double>(xs[i], ys[i])).toQPoint();
+}
+
+void Graphics::GraphicAssistant::computePointsOnDisplay(Pair<double> const& origin, float const* xs, float const* ys,
+                                                        int count, QPoint* displayPoints) const
+{
+    // Where the origin lands relative to the view's, once per call instead of per vertex.
+    Pair<double> const originOffset = origin - _private->_mapOrigin;
+    double const scale = _private->_scaleToDisplay;
+    Pair<double> const displayOrigin(_private->_displayOrigin);
+
+    int i = 0;
+
+#ifdef CL_HAVE_SSE2
+    __m128d const originOffsetX = _mm_set1_pd(originOffset.x());
+    __m128d const originOffsetY = _mm_set1_pd(originOffset.y());
+    __m128d const scaleX = _mm_set1_pd(scale);
+    __m128d const scaleY = _mm_set1_pd(-scale);
+    __m128d const displayOriginX = _mm_set1_pd(displayOrigin.x());
+    __m128d const displayOriginY = _mm_set1_pd(displayOrigin.y());
+
+    for (; i + 2 <= count; i += 2)
+    {
+        // Two floats widened to two doubles.
+        __m128d x = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(xs + i))));
+        __m128d y = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(ys + i))));
+
+        x = _mm_add_pd(_mm_mul_pd(_mm_add_pd(x, originOffsetX), scaleX), displayOriginX);
+        y = _mm_add_pd(_mm_mul_pd(_mm_add_pd(y, originOffsetY), scaleY), displayOriginY);
+
+        __m128i display = _mm_unpacklo_epi32(_mm_cvttpd_epi32(x), _mm_cvttpd_epi32(y));
+
+        displayPoints[i] = QPoint(_mm_cvtsi128_si32(display), _mm_cvtsi128_si32(_mm_srli_si128(display, 4)));
+        displayPoints[i + 1] = QPoint(_mm_cvtsi128_si32(_mm_srli_si128(display, 8)), _mm_cvtsi128_si32(_mm_srli_si128(display, 12)));
+    }
+#endif
+
+    for (; i < count; ++i)
+        displayPoints[i] = QPoint(int((double(xs[i]) + originOffset.x()) * scale + displayOrigin.x()),
+                                  int((double(ys[i]) + originOffset.y()) * -scale + displayOrigin.y()));
+}
+
 Pair<int> Graphics::GraphicAssistant::mapToDisplayXY(Pair<double> const& mapXY) const
 {
     return (mapXY - _private->_mapOrigin) * Pair<double>(1, -1) * _private->_scaleToDisplay + Pair<double>(_private->_displayOrigin);
@@ -122,6 +356,28 @@ Pair<double> Graphics::GraphicAssistant::displayToMapXY(Pair<int> const& display
     return Pair<double>(displayXY - _private->_displayOrigin) / _private->_scaleToDisplay / Pair<double>(1, -1) + _private->_mapOrigin;
 }
 
+int const Graphics::GraphicAssistant::ZoomLevelsPerOctave;
+
+int Graphics::GraphicAssistant::zoomLevel(float scale)
+{
+    return int(std::lround(std::log2(double(scale)) * ZoomLevelsPerOctave));
+}
+
+float Graphics::GraphicAssistant::levelScale(int level)
+{
+    return float(std::exp2(double(level) / ZoomLevelsPerOctave));
+}
+
+// The largest scale of the ladder not above the given one, so what fits still fits.
+static float fitToLadder(float scale)
+{
+    if (!(scale > 0) || std::isinf(scale))
+        return scale;
+
+    int level = int(std::floor(std::log2(double(scale)) * Graphics::GraphicAssistant::ZoomLevelsPerOctave));
+    return Graphics::GraphicAssistant::levelScale(level);
+}
+
 // make a specified layer fully displayed and centered
 void Graphics::GraphicAssistant::zoomToLayer(LayerIterator layerItr)
 {
@@ -132,7 +388,7 @@ void Graphics::GraphicAssistant::zoomToLayer(LayerIterator layerItr)
     Pair<float> scaleXY(Pair<float>(_private->_paintingRect.range()) / (*layerItr)->bounds().range());
 
     // Ensure the objects to be fully covered.
-    _private->_scaleToDisplay = COVER * scaleXY.smaller();
+    _private->_scaleToDisplay = fitToLadder(COVER * scaleXY.smaller());
 }
 
 Rect<double> Graphics::GraphicAssistant::computeMapHitBounds() const
@@ -166,7 +422,23 @@ void Graphics::GraphicAssistant::zoomAtCursor(Pair<int> const& mousePos, float s
     Pair<double> mapOrigin = displayToMapXY(displayOrigin);
     _private->_displayOrigin = displayOrigin;
     _private->_mapOrigin = mapOrigin;
-    _private->_scaleToDisplay *= scaleFactor;
+
+    float scale = _private->_scaleToDisplay;
+    if (!(scale > 0) || std::isinf(scale))
+    {
+        _private->_scaleToDisplay *= scaleFactor;
+        return;
+    }
+
+    // The nearest level to the scale asked for, but at least one level the way the wheel turned.
+    int level = zoomLevel(scale);
+    int targetLevel = zoomLevel(scale * scaleFactor);
+    if (scaleFactor > 1 && targetLevel <= level)
+        targetLevel = level + 1;
+    else if (scaleFactor < 1 && targetLevel >= level)
+        targetLevel = level - 1;
+
+    _private->_scaleToDisplay = levelScale(targetLevel);
 }
 
 void Graphics::GraphicAssistant::zoomToAll()
@@ -179,7 +451,7 @@ void Graphics::GraphicAssistant::zoomToAll()
 
     Pair<float> scaleXY(Pair<float>(_private->_paintingRect.range()) / globalBounds.range());
 
-    _private->_scaleToDisplay = COVER * scaleXY.smaller();
+    _private->_scaleToDisplay = fitToLadder(COVER * scaleXY.smaller());
 }
 
 Rect<double> DataManagement::ShapeDoc::computeGlobalBounds() const
@@ -209,6 +481,15 @@ Rect<double> DataManagement::ShapeDoc::computeGlobalBounds() const
     return Rect<double>(xMin, yMin, xMax, yMax);
 }
 
+int DataManagement::ShapeDoc::maxSymbolExtent() const
+{
+    int extent = 0;
+    for (auto const& layer : _layerList)
+        extent = std::max(extent, layer->symbolExtent());
+
+    return extent;
+}
+
 void Graphics::GraphicAssistant::translationStart(Pair<int> const& startPos)
 {
     Pair<int> displayOriginNew(startPos);
@@ -238,11 +519,16 @@ std::vector<std::string const*> DataManagement::ShapeDoc::rawNameList() const
 void DataManagement::ShapeView::draw(QPainter& painter)
 {
     QString recordStat = _shapeDoc.drawAllLayers(painter, _assistant);
-    dynamic_cast<ShapeViewObserver*>(_rawObserver)->setLabel(recordStat);
+    showStatus(recordStat);
+}
+
+void DataManagement::ShapeView::showStatus(QString const& status)
+{
+    dynamic_cast<ShapeViewObserver*>(_rawObserver)->setLabel(status);
 }
 
 DataManagement::DisplayManager::DisplayManager()
-    : _shapeDoc(), _assistant(_shapeDoc), _rawObserver(nullptr) {}
+    : _shapeDoc(), _assistant(_shapeDoc), _rawObserver(nullptr), _revision(0) {}
 
 Rect<int> const& Graphics::GraphicAssistant::paintingRect() const
 {
@@ -254,6 +540,28 @@ float Graphics::GraphicAssistant::scale() const
     return _private->_scaleToDisplay;
 }
 
+Graphics::SubPixelMode Graphics::GraphicAssistant::subPixelMode() const
+{
+    return _private->_refDoc.subPixelMode();
+}
+
+void Graphics::GraphicAssistant::setTransform(Pair<double> const& mapOrigin, Pair<int> const& displayOrigin, float scale)
+{
+    _private->_mapOrigin = mapOrigin;
+    _private->_displayOrigin = displayOrigin;
+    _private->_scaleToDisplay = scale;
+}
+
+void Graphics::GraphicAssistant::setCancelFlag(std::atomic<bool> const* cancelFlag)
+{
+    _private->_cancelFlag = cancelFlag;
+}
+
+bool Graphics::GraphicAssistant::isCancelled() const
+{
+    return _private->_cancelFlag && _private->_cancelFlag->load(std::memory_order_relaxed);
+}
+
 // Defined here to ensure the unique pointer of Private to be destructed properly.
 Graphics::GraphicAssistant::~GraphicAssistant() {}
 
@@ -263,6 +571,7 @@ DataManagement::ShapeDoc DataManagement::ShapeDoc::clone() const
 
     for (auto item : _layerList)
         docCopy._layerList.push_back(item->clone());
+    docCopy._subPixelMode = _subPixelMode;
 
     return docCopy;
 }
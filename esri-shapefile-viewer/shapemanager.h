@@ -5,6 +5,7 @@
 #include <memory>
 #include <vector>
 #include <list>
+#include <atomic>
 #include "../shapelib/shapefil.h"
 #include "nsdef.h"
 #include "support.h"
@@ -16,6 +17,15 @@ class QTime;
 class QPoint;
 class QString;
 
+// How polylines and polygons whose bounds fit inside one pixel are drawn.
+// All but Geometry skip reading such records.
+enum class cl::Graphics::SubPixelMode
+{
+    Geometry = 0, // Read and draw them like any other record.
+    Pixel,        // One pixel at the center of their bounds.
+    Density       // A raster counting them per pixel, more opaque where denser.
+};
+
 class cl::DataManagement::ShapeDoc
 {
 public:
@@ -23,32 +33,80 @@ public:
 
     bool isEmpty() const;
     QString drawAllLayers(QPainter& painter, Graphics::GraphicAssistant const& assistant) const;
+    Graphics::DrawStats drawLayers(QPainter& painter, Graphics::GraphicAssistant const& assistant) const;
+    QString describeDraw(Graphics::DrawStats const& stats, qint64 renderTime) const;
 
     bool addLayer(std::string const& path);
+    bool addLayer(std::string const& path, Dataset::OpenOptions const& options);
+    void addLayer(std::shared_ptr<Graphics::Shape> const& layer); // One opened elsewhere, e.g. by a LayerLoader.
     void removeLayer(LayerIterator layerItr);
     void rearrangeLayer(LayerIterator fromItr, LayerIterator toItr);
     void clearAllLayers();
 
+    // Draw the layer by the style, or with its own colors again if nullptr.
+    void setThematicStyle(LayerIterator layerItr, std::shared_ptr<Graphics::ThematicStyle const> const& style);
+
+    // Draw only the records of the layer the query selects, or all of them again if nullptr.
+    void setAttributeFilter(LayerIterator layerItr, std::shared_ptr<Dataset::AttributeFilter const> const& filter);
+
     std::vector<std::string const*> rawNameList() const;
+    std::list<std::shared_ptr<Graphics::Shape>> const& layers() const { return _layerList; }
     LayerIterator findByName(std::string const& name); // Cannot be marked as const.
     bool layerNotFound(LayerIterator layerItr) const;
     int layerCount() const;
     Rect<double> computeGlobalBounds() const;
+    int maxSymbolExtent() const; // The largest Shape::symbolExtent() of the layers.
+
+    Graphics::SubPixelMode subPixelMode() const { return _subPixelMode; }
+    void setSubPixelMode(Graphics::SubPixelMode subPixelMode);
+
+    // Bumped whenever a layer is added, removed or moved or the drawing changes,
+    // copies keep the revision they were taken at.
+    unsigned long revision() const { return _revision; }
 
 private:
     std::list<std::shared_ptr<Graphics::Shape>> _layerList;
+    unsigned long _revision = 0;
+    Graphics::SubPixelMode _subPixelMode = Graphics::SubPixelMode::Pixel;
 };
 
 class cl::Graphics::GraphicAssistant
 {
 public:
+    // The zooms keep the scale on a fixed ladder, ZoomLevelsPerOctave levels to a
+    // doubling, so that a zoom coming back by any path reaches the very same scale
+    // and finds the tiles rendered at it before.
+    static int const ZoomLevelsPerOctave = 4;
+
+    // The level nearest to a scale, and the scale of a level.
+    static int zoomLevel(float scale);
+    static float levelScale(int level);
+
     ~GraphicAssistant();
     GraphicAssistant(DataManagement::ShapeDoc const& refDoc);
 
+    // The same view and cancel flag as another assistant, over a different document.
+    GraphicAssistant(GraphicAssistant const& other, DataManagement::ShapeDoc const& refDoc);
+
+    // Drawing through this assistant stops early once the flag is raised.
+    void setCancelFlag(std::atomic<bool> const* cancelFlag);
+    bool isCancelled() const;
+
     void setPaintingRect(Rect<int> const& paintingRect);
+    void setTransform(Pair<double> const& mapOrigin, Pair<int> const& displayOrigin, float scale);
     Pair<int> mapToDisplayXY(Pair<double> const& mapXY) const;
     Pair<double> displayToMapXY(Pair<int> const& displayXY) const;
     Pair<int> computePointOnDisplay(SHPObject const& record, int ptIndex) const;
+    Pair<int> computePointOnDisplay(Dataset::PointSpan const& points, int ptIndex) const;
+
+    // Transform a whole span at once, bit-identical to mapToDisplayXY() per point.
+    void computePointsOnDisplay(Dataset::PointSpan const& points, QPoint* displayPoints) const;
+    void computePointsOnDisplay(double const* xs, double const* ys, int count, QPoint* displayPoints) const;
+
+    // Transform float offsets from origin, as kept by a GeometryStore. The sum is
+    // formed in double, so only the offsets' own rounding differs from the above.
+    void computePointsOnDisplay(Pair<double> const& origin, float const* xs, float const* ys, int count,
+                                QPoint* displayPoints) const;
     Rect<double> computeMapHitBounds() const;
 
     void zoomToAll();
@@ -59,6 +117,7 @@ public:
 
     Rect<int> const& paintingRect() const;
     float scale() const;
+    SubPixelMode subPixelMode() const; // The document's.
 
 private:
     class Private;
@@ -77,7 +136,10 @@ public:
     void setObserver(Observer& observer) { _rawObserver = &observer; }
     void setPaintingRect(Rect<int> const& paintingRect) { _assistant.setPaintingRect(paintingRect); }
 
-    void refresh() const { _rawObserver->updateDisplay(); }
+    void refresh() { ++_revision; _rawObserver->updateDisplay(); }
+
+    // Bumped on every change of the layers or the view, so a frame can tell it is outdated.
+    unsigned long revision() const { return _revision; }
 
     virtual void draw(QPainter& painter) = 0;
 
@@ -89,6 +151,7 @@ protected:
     DataManagement::ShapeDoc _shapeDoc;
     Graphics::GraphicAssistant _assistant;
     Observer* _rawObserver;
+    unsigned long _revision;
 };
 
 class cl::DataManagement::ShapeViewObserver : public DataManagement::Observer
@@ -103,13 +166,23 @@ public:
     static ShapeView& instance();
 
     void draw(QPainter& painter) override;
+    void showStatus(QString const& status);
 
     ShapeDoc const& shapeDoc() { return _shapeDoc; }
+    Graphics::GraphicAssistant const& assistant() const { return _assistant; }
 
     bool addLayer(std::string const& path) { bool flag = _shapeDoc.addLayer(path); if (flag) refresh(); return flag; }
+    bool addLayer(std::string const& path, Dataset::OpenOptions const& options)
+    { bool flag = _shapeDoc.addLayer(path, options); if (flag) refresh(); return flag; }
+    void addLayer(std::shared_ptr<Graphics::Shape> const& layer) { _shapeDoc.addLayer(layer); refresh(); }
     void removeLayer(LayerIterator layerItr) { _shapeDoc.removeLayer(layerItr); refresh(); }
     void rearrangeLayer(LayerIterator fromItr, LayerIterator toItr) { _shapeDoc.rearrangeLayer(fromItr, toItr); refresh(); }
     void clearAllLayers() { _shapeDoc.clearAllLayers(); refresh(); }
+    void setThematicStyle(LayerIterator layerItr, std::shared_ptr<Graphics::ThematicStyle const> const& style)
+    { _shapeDoc.setThematicStyle(layerItr, style); refresh(); }
+    void setAttributeFilter(LayerIterator layerItr, std::shared_ptr<Dataset::AttributeFilter const> const& filter)
+    { _shapeDoc.setAttributeFilter(layerItr, filter); refresh(); }
+    void setSubPixelMode(Graphics::SubPixelMode subPixelMode) { _shapeDoc.setSubPixelMode(subPixelMode); refresh(); }
     LayerIterator findByName(std::string const& name) { return _shapeDoc.findByName(name); }
     bool layerNotFound(LayerIterator layerItr) const { return _shapeDoc.layerNotFound(layerItr); }
     std::vector<std::string const*> rawNameList() const { return _shapeDoc.rawNameList(); }
@@ -4,8 +4,31 @@
 #include <QRect>
 #include <QPoint>
 #include <QSize>
+#include <cstring>
 #include "nsdef.h"
 
+// SSE2 is part of every x86-64 target, code using it keeps a scalar fallback for the rest.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CL_HAVE_SSE2
+#endif
+
+// Read a little-endian value from a possibly unaligned address,
+// as found in the records of a shapefile.
+template<typename T>
+inline T cl::readLittleEndian(unsigned char const* bytes)
+{
+    T value;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    std::memcpy(&value, bytes, sizeof(T));
+#else
+    unsigned char swapped[sizeof(T)];
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+        swapped[i] = bytes[sizeof(T) - 1 - i];
+    std::memcpy(&value, swapped, sizeof(T));
+#endif
+    return value;
+}
+
 template<typename T>
 class cl::Pair
 {
@@ -0,0 +1,14 @@
+QT       += core gui testlib
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = tst_geometrystore
+TEMPLATE = app
+CONFIG += testcase console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../../esri-shapefile-viewer.pri)
+
+SOURCES += tst_geometrystore.cpp
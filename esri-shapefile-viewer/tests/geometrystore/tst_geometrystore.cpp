@@ -0,0 +1,152 @@
+#include <QtTest>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+#include "geometrystore.h"
+
+using namespace cl;
+
+// A GeometryStore keeps vertices as float offsets from an origin per record. Every
+// coordinate decoded as a draw decodes it must stay within GeometryStore::errorBound()
+// and the store's own maxError(), on the cases where the offsets are worst.
+class TestGeometryStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void errorWithinBound_data();
+    void errorWithinBound();
+};
+
+namespace
+{
+typedef std::vector<Pair<double>> Part;
+typedef std::function<void(std::mt19937&, Part&)> MakeRecord;
+
+struct Case
+{
+    char const* name;
+    Rect<double> bounds;
+    MakeRecord makeRecord;
+};
+
+// Records of a few vertices scattered over the bounds, each within spread of its first vertex.
+MakeRecord scattered(Rect<double> const& bounds, double spread)
+{
+    return [bounds, spread](std::mt19937& generator, Part& part)
+    {
+        std::uniform_real_distribution<double> x(bounds.xMin(), bounds.xMax()), y(bounds.yMin(), bounds.yMax());
+        std::uniform_real_distribution<double> offset(-spread, spread);
+        std::uniform_int_distribution<int> size(1, 8);
+
+        Pair<double> first(x(generator), y(generator));
+        part.assign(1, first);
+        for (int i = size(generator); i > 1; --i)
+            part.push_back(first + Pair<double>(offset(generator), offset(generator)));
+    };
+}
+
+std::vector<Case> const& cases()
+{
+    static double const mercator = 20037508.342789244;
+    static Rect<double> const world(-180, -90, 180, 90);
+
+    static std::vector<Case> const cases =
+    {
+        {"unit square", Rect<double>(0, 0, 1, 1), scattered(Rect<double>(0, 0, 1, 1), 1e-3)},
+        {"web mercator", Rect<double>(-mercator, -mercator, mercator, mercator),
+         scattered(Rect<double>(-mercator, -mercator, mercator, mercator), 1e3)},
+        {"far from the origin", Rect<double>(1e9, -1e9 - 1e3, 1e9 + 1e3, -1e9),
+         scattered(Rect<double>(1e9, -1e9 - 1e3, 1e9 + 1e3, -1e9), 1.0)},
+        {"huge coordinates", Rect<double>(-1e15, -1e15, 1e15, 1e15),
+         scattered(Rect<double>(-1e15, -1e15, 1e15, 1e15), 1e12)},
+        {"records spanning the extent", world, [](std::mt19937& generator, Part& part)
+         {
+             std::uniform_real_distribution<double> x(world.xMin(), world.xMax()), y(world.yMin(), world.yMax());
+             part = {Pair<double>(world.xMin(), world.yMin()), Pair<double>(world.xMax(), world.yMax()),
+                     Pair<double>(x(generator), y(generator)), Pair<double>(world.xMin(), world.yMax())};
+         }},
+        {"zero width", Rect<double>(5, 0, 5, 100), [](std::mt19937& generator, Part& part)
+         {
+             std::uniform_real_distribution<double> y(0, 100);
+             part = {Pair<double>(5, y(generator)), Pair<double>(5, y(generator))};
+         }},
+        {"a single point", Rect<double>(3, 4, 3, 4), [](std::mt19937&, Part& part)
+         {
+             part.assign(2, Pair<double>(3, 4));
+         }},
+        {"vertices outside the bounds", Rect<double>(0, 0, 1, 1),
+         scattered(Rect<double>(-1e3, -1e3, 1e3, 1e3), 10.0)},
+    };
+
+    return cases;
+}
+}
+
+void TestGeometryStore::errorWithinBound_data()
+{
+    QTest::addColumn<int>("caseIndex");
+
+    for (int i = 0; i < int(cases().size()); ++i)
+        QTest::newRow(cases()[i].name) << i;
+}
+
+void TestGeometryStore::errorWithinBound()
+{
+    QFETCH(int, caseIndex);
+    Case const& testCase = cases()[caseIndex];
+
+    int const recordCount = 2000;
+
+    // A fixed seed keeps the records identical between runs.
+    std::mt19937 generator(20170420);
+    std::vector<Part> records(recordCount);
+    for (auto& record : records)
+        testCase.makeRecord(generator, record);
+
+    Dataset::GeometryStore store(testCase.bounds);
+    for (auto const& record : records)
+    {
+        store.beginRecord();
+        store.beginPart();
+        for (auto const& vertex : record)
+            store.addVertex(vertex.x(), vertex.y());
+    }
+    store.finish();
+
+    QCOMPARE(store.recordCount(), recordCount);
+
+    for (int recordId = 0; recordId < recordCount; ++recordId)
+    {
+        Pair<double> origin = store.recordOrigin(recordId);
+        int partIndex = store.firstPart(recordId);
+        Part const& record = records[recordId];
+
+        QCOMPARE(store.firstPart(recordId + 1), partIndex + 1);
+        QCOMPARE(store.partSize(partIndex), int(record.size()));
+
+        for (std::size_t i = 0; i < record.size(); ++i)
+        {
+            // Decoded as a draw does, from the record's origin and the float offsets.
+            double const decoded[2] = {origin.x() + double(store.partXs(partIndex)[i]),
+                                       origin.y() + double(store.partYs(partIndex)[i])};
+            double const original[2] = {record[i].x(), record[i].y()};
+            double const origins[2] = {origin.x(), origin.y()};
+
+            for (int axis = 0; axis < 2; ++axis)
+            {
+                double error = std::abs(decoded[axis] - original[axis]);
+                double bound = Dataset::GeometryStore::errorBound(original[axis], origins[axis]);
+
+                QVERIFY2(error <= bound && error <= store.maxError(),
+                         qPrintable(QString("record %1, vertex %2, axis %3: error %4, bound %5, maxError %6")
+                                    .arg(recordId).arg(i).arg(axis).arg(error).arg(bound).arg(store.maxError())));
+            }
+        }
+    }
+}
+
+QTEST_APPLESS_MAIN(TestGeometryStore)
+
+#include "tst_geometrystore.moc"
@@ -0,0 +1,6 @@
+# Run with: qmake && make check
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    geometrystore
@@ -0,0 +1,190 @@
+#include "thematicstyle.h"
+#include <algorithm>
+#include <limits>
+#include "attributecolumns.h"
+
+using namespace cl;
+
+int const Graphics::ThematicStyle::MaxClassCount;
+int const Graphics::ThematicStyle::SampleSize;
+
+// Scratch for grouping, one per thread since tiles are drawn concurrently.
+static thread_local std::vector<int> groupedRecords;
+static thread_local std::vector<int> groupNextPositions;
+
+Graphics::ThematicStyle::ThematicStyle(Dataset::AttributeColumns const& attributes, int field, int recordCount,
+                                       Classification classification, int classCount,
+                                       QColor const& lowColor, QColor const& highColor)
+    : _fieldName(attributes.fieldName(field)), _classification(classification)
+{
+    typedef Dataset::AttributeColumns::ColumnType ColumnType;
+
+    classCount = std::max(1, std::min(MaxClassCount, classCount));
+
+    Dataset::AttributeColumns::Column const& column = attributes.column(field);
+    if (column.type == ColumnType::String)
+        return;
+
+    int const valueCount = std::min(recordCount, attributes.recordCount());
+
+    std::vector<double> sortedValues;
+    sortedValues.reserve(valueCount);
+    for (int record = 0; record < valueCount; ++record)
+        if (!column.isNull(record))
+            sortedValues.push_back(column.number(record));
+
+    if (sortedValues.empty())
+        return;
+
+    std::sort(sortedValues.begin(), sortedValues.end());
+
+    switch (classification)
+    {
+    case Classification::EqualInterval:
+        computeEqualIntervalBreaks(sortedValues, classCount);
+        break;
+
+    case Classification::Quantile:
+        computeQuantileBreaks(sortedValues, classCount);
+        break;
+
+    case Classification::NaturalBreaks:
+        computeNaturalBreaks(sortedValues, classCount);
+        break;
+    }
+
+    // The fills ramp from the low to the high color, outlines are a shade darker.
+    for (int classIndex = 0; classIndex < classCount; ++classIndex)
+    {
+        double t = classCount == 1 ? 1.0 : double(classIndex) / (classCount - 1);
+        auto mix = [t](int low, int high) { return int(low + (high - low) * t + 0.5); };
+
+        _colors.push_back(QColor(mix(lowColor.red(), highColor.red()),
+                                 mix(lowColor.green(), highColor.green()),
+                                 mix(lowColor.blue(), highColor.blue())));
+    }
+    _colors.push_back(QColor(200, 200, 200)); // No value.
+
+    for (auto const& color : _colors)
+    {
+        _pens.push_back(QPen(color.darker(130)));
+        _brushes.push_back(QBrush(color));
+    }
+
+    // The class of a value is the first whose upper bound is not below it.
+    _recordStyles.assign(recordCount, (unsigned char)classCount);
+    for (int record = 0; record < valueCount; ++record)
+        _recordStyles[record] = column.isNull(record)
+                ? (unsigned char)classCount
+                : (unsigned char)(std::lower_bound(_breaks.begin() + 1, _breaks.end() - 1, column.number(record))
+                                  - (_breaks.begin() + 1));
+}
+
+void Graphics::ThematicStyle::groupByStyle(std::vector<int>& records, std::vector<int>& styleStarts) const
+{
+    // A counting sort, the records are only a view's worth and the styles few.
+    styleStarts.assign(styleCount() + 1, 0);
+    for (auto record : records)
+        ++styleStarts[_recordStyles[record] + 1];
+
+    for (int style = 0; style < styleCount(); ++style)
+        styleStarts[style + 1] += styleStarts[style];
+
+    std::vector<int>& nextPositions = groupNextPositions;
+    nextPositions.assign(styleStarts.begin(), styleStarts.end() - 1);
+
+    std::vector<int>& grouped = groupedRecords;
+    grouped.resize(records.size());
+    for (auto record : records)
+        grouped[nextPositions[_recordStyles[record]]++] = record;
+
+    // Both buffers keep their capacity for the next draw.
+    records.swap(grouped);
+}
+
+void Graphics::ThematicStyle::computeEqualIntervalBreaks(std::vector<double> const& sortedValues, int classCount)
+{
+    double const minValue = sortedValues.front(), maxValue = sortedValues.back();
+
+    _breaks.push_back(minValue);
+    for (int classIndex = 1; classIndex < classCount; ++classIndex)
+        _breaks.push_back(minValue + (maxValue - minValue) * classIndex / classCount);
+    _breaks.push_back(maxValue);
+}
+
+void Graphics::ThematicStyle::computeQuantileBreaks(std::vector<double> const& sortedValues, int classCount)
+{
+    std::size_t const valueCount = sortedValues.size();
+
+    _breaks.push_back(sortedValues.front());
+    for (int classIndex = 1; classIndex < classCount; ++classIndex)
+        _breaks.push_back(sortedValues[(valueCount * classIndex + classCount - 1) / classCount - 1]);
+    _breaks.push_back(sortedValues.back());
+}
+
+// Fisher's exact optimization, as Jenks used it: for every prefix of the values
+// and every number of classes, the least sum of squared deviations and where its
+// last class starts.
+void Graphics::ThematicStyle::computeNaturalBreaks(std::vector<double> const& sortedValues, int classCount)
+{
+    std::vector<double> values;
+    if (int(sortedValues.size()) <= SampleSize)
+        values = sortedValues;
+    else
+        for (int i = 0; i < SampleSize; ++i)
+            values.push_back(sortedValues[(sortedValues.size() - 1) * i / (SampleSize - 1)]);
+
+    int const valueCount = int(values.size());
+    int const columnCount = classCount + 1;
+
+    // Row l is the first l values, column j the number of classes.
+    std::vector<int> lastClassStarts(std::size_t(valueCount + 1) * columnCount, 1);
+    std::vector<double> costs(std::size_t(valueCount + 1) * columnCount, std::numeric_limits<double>::infinity());
+
+    for (int j = 1; j <= classCount; ++j)
+        costs[columnCount + j] = 0.0;
+
+    for (int l = 2; l <= valueCount; ++l)
+    {
+        double sum = 0, sumOfSquares = 0, variance = 0;
+
+        for (int m = 1; m <= l; ++m)
+        {
+            // The last class holds values first .. l, one-based.
+            int const first = l - m + 1;
+            double const value = values[first - 1];
+            sum += value;
+            sumOfSquares += value * value;
+            variance = sumOfSquares - sum * sum / m;
+
+            if (first == 1)
+                continue;
+
+            for (int j = 2; j <= classCount; ++j)
+            {
+                double cost = variance + costs[std::size_t(first - 1) * columnCount + j - 1];
+                if (cost <= costs[std::size_t(l) * columnCount + j])
+                {
+                    lastClassStarts[std::size_t(l) * columnCount + j] = first;
+                    costs[std::size_t(l) * columnCount + j] = cost;
+                }
+            }
+        }
+
+        lastClassStarts[std::size_t(l) * columnCount + 1] = 1;
+        costs[std::size_t(l) * columnCount + 1] = variance;
+    }
+
+    // Walk back from the whole set, each class ends just before the next one starts.
+    _breaks.assign(classCount + 1, 0.0);
+    _breaks.front() = sortedValues.front();
+    _breaks.back() = sortedValues.back();
+
+    int end = valueCount;
+    for (int j = classCount; j >= 2; --j)
+    {
+        int start = lastClassStarts[std::size_t(end) * columnCount + j];
+        _breaks[j - 1] = values[std::max(0, start - 2)];
+        end = std::max(1, start - 1);
+    }
+}
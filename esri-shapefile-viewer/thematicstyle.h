@@ -0,0 +1,76 @@
+#ifndef THEMATICSTYLE_H
+#define THEMATICSTYLE_H
+
+#include <QBrush>
+#include <QColor>
+#include <QPen>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "nsdef.h"
+
+// How the values of a field are split into classes.
+enum class cl::Graphics::Classification
+{
+    EqualInterval = 0, // Classes of the same width from the smallest value to the largest.
+    Quantile,          // Classes of about the same number of records.
+    NaturalBreaks      // Jenks: the breaks that leave the least variance within the classes.
+};
+
+// A layer drawn by the value of a numeric field: a choropleth for polygons,
+// graduated colors for lines and points. Every record is classified once, here,
+// into the index of its style, so a draw only groups the records it hits by
+// that index and sets the pen and brush once per class. Records without a
+// value have a style of their own, after the classes.
+class cl::Graphics::ThematicStyle
+{
+public:
+    static int const MaxClassCount = 16;
+
+    // Classify the field into classCount classes, whose fills ramp from lowColor
+    // to highColor. Natural breaks are computed on at most SampleSize values spread
+    // evenly over the sorted ones, the exact optimization being quadratic.
+    // recordCount is that of the .shp, the records the .dbf has no row for have no value.
+    ThematicStyle(Dataset::AttributeColumns const& attributes, int field, int recordCount,
+                  Classification classification, int classCount, QColor const& lowColor, QColor const& highColor);
+
+    // False for a field that is not numeric or has no value at all, nothing is classified then.
+    bool isValid() const { return !_breaks.empty(); }
+
+    std::string const& fieldName() const { return _fieldName; }
+    Classification classification() const { return _classification; }
+
+    int classCount() const { return int(_breaks.size()) - 1; }
+    int styleCount() const { return int(_pens.size()); }
+
+    // The smallest value, the upper bound of every class and so the largest value last.
+    std::vector<double> const& breaks() const { return _breaks; }
+
+    int styleIndex(int recordId) const { return _recordStyles[recordId]; }
+    QPen const& pen(int styleIndex) const { return _pens[styleIndex]; }
+    QBrush const& brush(int styleIndex) const { return _brushes[styleIndex]; }
+    QColor const& color(int styleIndex) const { return _colors[styleIndex]; }
+
+    // Reorder the records by style, the records of a style keeping their order.
+    // styleStarts gets the position of the first record of every style, then the size.
+    void groupByStyle(std::vector<int>& records, std::vector<int>& styleStarts) const;
+
+    std::size_t memoryUsage() const { return _recordStyles.capacity(); }
+
+private:
+    static int const SampleSize = 1024;
+
+    void computeEqualIntervalBreaks(std::vector<double> const& sortedValues, int classCount);
+    void computeQuantileBreaks(std::vector<double> const& sortedValues, int classCount);
+    void computeNaturalBreaks(std::vector<double> const& sortedValues, int classCount);
+
+    std::string _fieldName;
+    Classification _classification;
+    std::vector<double> _breaks;
+    std::vector<unsigned char> _recordStyles;
+    std::vector<QColor> _colors; // The fill of every style.
+    std::vector<QPen> _pens;
+    std::vector<QBrush> _brushes;
+};
+
+#endif // THEMATICSTYLE_H
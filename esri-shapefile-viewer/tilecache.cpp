@@ -0,0 +1,179 @@
+#include "tilecache.h"
+#include <QPainter>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include "shapedata.h"
+#include "shapemanager.h"
+#include "workstealingpool.h"
+
+using namespace cl;
+
+int const Graphics::TileCache::TileSize;
+
+// Round towards negative infinity, so the tiles left of and above the origin are numbered -1, -2, ...
+static qint64 floorDivide(qint64 value, qint64 divisor)
+{
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+std::size_t Graphics::TileCache::KeyHash::operator() (Key const& key) const
+{
+    std::size_t hash = std::hash<unsigned long>()(key.docRevision);
+    hash = hash * 31 + std::hash<quint32>()(key.scaleBits);
+    hash = hash * 31 + std::hash<qint64>()(key.x);
+    hash = hash * 31 + std::hash<qint64>()(key.y);
+    return hash;
+}
+
+Graphics::TileCache::TileCache(WorkStealingPool* pool, std::size_t budgetBytes)
+    : _budgetBytes(budgetBytes), _memoryUsage(0), _docRevision(0), _pool(pool), _workerLimit(0) {}
+
+void Graphics::TileCache::clear()
+{
+    _tiles.clear();
+    _index.clear();
+    _memoryUsage = 0;
+}
+
+QImage const* Graphics::TileCache::find(Key const& key)
+{
+    auto found = _index.find(key);
+    if (found == _index.end())
+        return nullptr;
+
+    _tiles.splice(_tiles.begin(), _tiles, found->second);
+    return &found->second->second;
+}
+
+static std::size_t imageBytes(QImage const& image)
+{
+    return std::size_t(image.bytesPerLine()) * image.height();
+}
+
+void Graphics::TileCache::insert(Key const& key, QImage const& tile)
+{
+    _tiles.emplace_front(key, tile);
+    _index[key] = _tiles.begin();
+    _memoryUsage += imageBytes(tile);
+
+    while (_memoryUsage > _budgetBytes && _tiles.size() > 1)
+    {
+        _memoryUsage -= imageBytes(_tiles.back().second);
+        _index.erase(_tiles.back().first);
+        _tiles.pop_back();
+    }
+}
+
+Graphics::DrawStats Graphics::TileCache::draw(QPainter& painter, DataManagement::ShapeDoc const& shapeDoc,
+                                              GraphicAssistant const& assistant, QRect const& region)
+{
+    DrawStats stats;
+
+    // Tiles of an older layer set can never be hit again.
+    if (shapeDoc.revision() != _docRevision)
+    {
+        clear();
+        _docRevision = shapeDoc.revision();
+    }
+
+    float const scale = assistant.scale();
+    quint32 scaleBits;
+    std::memcpy(&scaleBits, &scale, sizeof(scaleBits));
+
+    // The tile grid counts pixels from the map origin at this scale. The view's
+    // top left pixel is rounded onto that grid so that adjacent tiles meet exactly.
+    Pair<double> viewOrigin = assistant.displayToMapXY(Pair<int>(0, 0));
+    qint64 worldX = qint64(std::floor(viewOrigin.x() * scale + 0.5));
+    qint64 worldY = qint64(std::floor(-viewOrigin.y() * scale + 0.5));
+
+    qint64 firstX = floorDivide(worldX + region.left(), TileSize);
+    qint64 lastX = floorDivide(worldX + region.right(), TileSize);
+    qint64 firstY = floorDivide(worldY + region.top(), TileSize);
+    qint64 lastY = floorDivide(worldY + region.bottom(), TileSize);
+
+    // Blit what is cached and collect the rest.
+    struct MissingTile
+    {
+        Key key;
+        QPoint position;
+        QImage image;
+        DrawStats stats;
+        bool complete;
+    };
+    std::vector<MissingTile> missingTiles;
+
+    for (qint64 tileY = firstY; tileY <= lastY; ++tileY)
+        for (qint64 tileX = firstX; tileX <= lastX; ++tileX)
+        {
+            Key key = {_docRevision, scaleBits, tileX, tileY};
+            QPoint position(int(tileX * TileSize - worldX), int(tileY * TileSize - worldY));
+
+            if (QImage const* tile = find(key))
+            {
+                painter.drawImage(position, *tile);
+                ++stats.tilesCached;
+            }
+            else
+            {
+                missingTiles.push_back({key, position, QImage(), DrawStats(), false});
+            }
+        }
+
+    if (missingTiles.empty() || assistant.isCancelled())
+        return stats;
+
+    int const margin = shapeDoc.maxSymbolExtent();
+
+    // Each tile gets its own image, painter and view, nothing is shared but the read-only layers.
+    auto rasterize = [&](MissingTile& missing)
+    {
+        GraphicAssistant tileAssistant(assistant, shapeDoc);
+        tileAssistant.setTransform(Pair<double>(missing.key.x * TileSize / double(scale),
+                                                -(missing.key.y * TileSize) / double(scale)),
+                                   Pair<int>(0, 0), scale);
+        // Query a margin around the tile, so that the symbols of records just outside it
+        // are drawn into it where they overlap. The image itself clips them to the tile.
+        tileAssistant.setPaintingRect(Rect<int>(-margin, -margin, TileSize - 1 + margin, TileSize - 1 + margin));
+
+        if (tileAssistant.isCancelled())
+            return;
+
+        missing.image = QImage(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+        missing.image.fill(Qt::transparent);
+
+        QPainter tilePainter(&missing.image);
+        tilePainter.setRenderHint(QPainter::Antialiasing);
+        missing.stats = shapeDoc.drawLayers(tilePainter, tileAssistant);
+        tilePainter.end();
+
+        missing.complete = !tileAssistant.isCancelled();
+    };
+
+    if (_pool && missingTiles.size() > 1)
+    {
+        std::vector<WorkStealingPool::Task> tasks;
+        for (auto& missing : missingTiles)
+            tasks.push_back([&rasterize, &missing](int) { rasterize(missing); });
+        _pool->run(tasks, _workerLimit);
+    }
+    else
+    {
+        for (auto& missing : missingTiles)
+            rasterize(missing);
+    }
+
+    // A cancelled tile is incomplete, it is neither cached nor shown.
+    for (auto& missing : missingTiles)
+    {
+        if (!missing.complete)
+            continue;
+
+        stats += missing.stats;
+        ++stats.tilesRendered;
+        insert(missing.key, missing.image);
+        painter.drawImage(missing.position, missing.image);
+    }
+
+    return stats;
+}
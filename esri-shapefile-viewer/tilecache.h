@@ -0,0 +1,71 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QImage>
+#include <QRect>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include "nsdef.h"
+#include "support.h"
+
+class QPainter;
+
+// Rendered layers kept as square tiles on a grid fixed in map space for each scale,
+// so panning over or returning to an area at a scale seen before only blits tiles.
+// Tiles are keyed by the document revision, the exact scale and the tile position,
+// and the least recently used ones are dropped beyond the memory budget. Tiles are
+// rendered at the view's own scale, never stretched; the view keeps its scale on
+// the zoom ladder of GraphicAssistant, so that zooming back finds the same scale.
+// Missing tiles are rasterized in parallel on the pool, if one is given.
+// Not thread-safe, meant to be owned by the render thread.
+class cl::Graphics::TileCache
+{
+public:
+    static int const TileSize = 256;
+
+    explicit TileCache(WorkStealingPool* pool = nullptr, std::size_t budgetBytes = std::size_t(128) << 20);
+
+    // Rasterize on at most this many of the pool's threads, zero for all of them.
+    void setWorkerLimit(int workerLimit) { _workerLimit = workerLimit; }
+
+    // Draw the tiles covering the region of the view, rendering and caching the missing ones.
+    DrawStats draw(QPainter& painter, DataManagement::ShapeDoc const& shapeDoc,
+                   GraphicAssistant const& assistant, QRect const& region);
+
+    void clear();
+    std::size_t memoryUsage() const { return _memoryUsage; }
+
+private:
+    struct Key
+    {
+        unsigned long docRevision;
+        quint32 scaleBits;
+        qint64 x, y;
+
+        bool operator== (Key const& other) const
+        { return docRevision == other.docRevision && scaleBits == other.scaleBits && x == other.x && y == other.y; }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator() (Key const& key) const;
+    };
+
+    typedef std::list<std::pair<Key, QImage>> TileList;
+
+    QImage const* find(Key const& key);
+    void insert(Key const& key, QImage const& tile);
+
+    std::size_t _budgetBytes;
+    std::size_t _memoryUsage;
+    unsigned long _docRevision;
+
+    WorkStealingPool* _pool;
+    int _workerLimit;
+
+    TileList _tiles; // Most recently used first.
+    std::unordered_map<Key, TileList::iterator, KeyHash> _index;
+};
+
+#endif // TILECACHE_H
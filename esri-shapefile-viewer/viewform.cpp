@@ -10,21 +10,49 @@ ViewForm::ViewForm(QWidget* parent)
     ui->setupUi(this);
 
     setCursor(QCursor(Qt::CursorShape::OpenHandCursor));
+
+    _renderThread.reset(new RenderThread(this));
+    connect(_renderThread.get(), SIGNAL(renderedImage(QImage, QRectF, QString)),
+            this, SLOT(updateFrame(QImage, QRectF, QString)));
 }
 
 ViewForm::~ViewForm() {}
 
 void ViewForm::paintEvent(QPaintEvent*)
-{    
-    cl::DataManagement::ShapeView::instance().setPaintingRect(rect());
+{
+    using namespace cl::DataManagement;
+
+    ShapeView::instance().setPaintingRect(rect());
+
+    // Ask for a new frame whenever the layers, the view or the size changed since the last request.
+    if (_requestedRevision != ShapeView::instance().revision() || _requestedSize != size())
+    {
+        _requestedRevision = ShapeView::instance().revision();
+        _requestedSize = size();
+        _renderThread->render(ShapeView::instance().shapeDoc(), ShapeView::instance().assistant(), size());
+    }
+
+    if (_frame.isNull())
+        return;
+
+    // Place the last frame where its corners fall in the current view,
+    // which scales and moves it along with a zoom or pan still being rendered.
+    cl::Graphics::GraphicAssistant const& assistant = ShapeView::instance().assistant();
+    cl::Pair<int> topLeft = assistant.mapToDisplayXY(cl::Pair<double>(_frameMapCorners.left(), _frameMapCorners.top()));
+    cl::Pair<int> bottomRight = assistant.mapToDisplayXY(cl::Pair<double>(_frameMapCorners.right(), _frameMapCorners.bottom()));
 
     QPainter painter(this);
-    painter.begin(this);
-    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(QRectF(QPointF(topLeft.toQPoint()), QPointF(bottomRight.toQPoint())), _frame);
+}
 
-    cl::DataManagement::ShapeView::instance().draw(painter);
+void ViewForm::updateFrame(QImage const& image, QRectF const& mapCorners, QString const& status)
+{
+    _frame = image;
+    _frameMapCorners = mapCorners;
 
-    painter.end();
+    cl::DataManagement::ShapeView::instance().showStatus(status);
+    update();
 }
 
 void ViewForm::wheelEvent(QWheelEvent* event)
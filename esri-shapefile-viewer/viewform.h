@@ -2,7 +2,10 @@
 #define VIEWFORM_H
 
 #include <QWidget>
+#include <QImage>
+#include <QRectF>
 #include <memory>
+#include "renderthread.h"
 
 namespace Ui { class ViewForm; }
 
@@ -24,6 +27,16 @@ private:
 
     std::unique_ptr<Ui::ViewForm> ui;
     bool _mouseDragging = false;
+
+    // The last finished frame, shown under the current view until the next one arrives.
+    std::unique_ptr<RenderThread> _renderThread;
+    QImage _frame;
+    QRectF _frameMapCorners;
+    unsigned long _requestedRevision = 0;
+    QSize _requestedSize;
+
+private slots:
+    void updateFrame(QImage const& image, QRectF const& mapCorners, QString const& status);
 };
 
 #endif // VIEWFORM_H
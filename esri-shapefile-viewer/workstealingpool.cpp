@@ -0,0 +1,128 @@
+#include "workstealingpool.h"
+#include <algorithm>
+
+using namespace cl;
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+    : _tasks(nullptr), _pendingCount(0), _workerLimit(0), _batch(0), _stop(false)
+{
+    if (threadCount <= 0)
+        threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+
+    for (int i = 0; i < threadCount; ++i)
+        _queues.emplace_back(new Queue());
+
+    for (int i = 1; i < threadCount; ++i)
+        _threads.emplace_back(&WorkStealingPool::work, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+
+    for (auto& thread : _threads)
+        thread.join();
+}
+
+void WorkStealingPool::run(std::vector<Task> const& tasks, int workerLimit)
+{
+    if (tasks.empty())
+        return;
+
+    if (workerLimit <= 0 || workerLimit > threadCount())
+        workerLimit = threadCount();
+    workerLimit = std::min(workerLimit, int(tasks.size()));
+
+    _tasks = &tasks;
+    _pendingCount = int(tasks.size());
+
+    // Set before dealing, so a worker left over from the last batch outside the limit takes nothing.
+    _workerLimit = workerLimit;
+
+    // Deal the tasks out in turn, neighbouring tasks tend to cost about the same.
+    for (int i = 0; i < int(tasks.size()); ++i)
+    {
+        Queue& queue = *_queues[i % workerLimit];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.taskIndices.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_batch;
+    }
+    _wake.notify_all();
+
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this]() { return _pendingCount == 0; });
+    _tasks = nullptr;
+}
+
+void WorkStealingPool::work(int workerIndex)
+{
+    unsigned long batchSeen = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&]() { return _stop || (_batch != batchSeen && workerIndex < _workerLimit); });
+            if (_stop)
+                return;
+            batchSeen = _batch;
+        }
+
+        drain(workerIndex);
+    }
+}
+
+void WorkStealingPool::drain(int workerIndex)
+{
+    int taskIndex;
+    while (workerIndex < _workerLimit && takeTask(workerIndex, taskIndex))
+    {
+        (*_tasks)[taskIndex](workerIndex);
+
+        if (--_pendingCount == 0)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _done.notify_all();
+        }
+    }
+}
+
+bool WorkStealingPool::takeTask(int workerIndex, int& taskIndex)
+{
+    // The newest task of our own queue first, it is the one most likely to share cached data.
+    {
+        Queue& own = *_queues[workerIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.taskIndices.empty())
+        {
+            taskIndex = own.taskIndices.back();
+            own.taskIndices.pop_back();
+            return true;
+        }
+    }
+
+    // Then the oldest task of any other queue.
+    for (int offset = 1; offset < threadCount(); ++offset)
+    {
+        Queue& victim = *_queues[(workerIndex + offset) % threadCount()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.taskIndices.empty())
+        {
+            taskIndex = victim.taskIndices.front();
+            victim.taskIndices.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
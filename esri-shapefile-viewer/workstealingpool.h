@@ -0,0 +1,60 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "nsdef.h"
+
+// A fixed set of threads running batches of tasks. Each worker has its own queue,
+// takes work from its back and, once empty, steals from the front of the others,
+// so uneven tasks (a dense tile next to an empty one) still keep every core busy.
+class cl::WorkStealingPool
+{
+public:
+    typedef std::function<void(int workerIndex)> Task;
+
+    // Zero threads means one per hardware thread. The calling thread counts as worker 0.
+    explicit WorkStealingPool(int threadCount = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(WorkStealingPool const&) = delete;
+    WorkStealingPool& operator= (WorkStealingPool const&) = delete;
+
+    int threadCount() const { return int(_queues.size()); }
+
+    // Run every task on at most workerLimit workers (zero for all) and return once all are done.
+    // Not reentrant, one batch runs at a time.
+    void run(std::vector<Task> const& tasks, int workerLimit = 0);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<int> taskIndices;
+    };
+
+    void work(int workerIndex);
+    void drain(int workerIndex);
+    bool takeTask(int workerIndex, int& taskIndex);
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+
+    std::vector<Task> const* _tasks;
+    std::atomic<int> _pendingCount;
+    std::atomic<int> _workerLimit;
+    unsigned long _batch;
+    bool _stop;
+};
+
+#endif // WORKSTEALINGPOOL_H
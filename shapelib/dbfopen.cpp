@@ -190,6 +190,7 @@ static char rcsid[] =
 #include <math.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
 
 #ifndef FALSE
@@ -295,6 +296,45 @@ static void DBFFlushRecord( DBFHandle psDBF )
     }
 }
 
+/************************************************************************/
+/*                           DBFGetRecord()                             */
+/*                                                                      */
+/*      The bytes of a record, in the mapping if there is one and       */
+/*      read into the current record buffer otherwise.                  */
+/************************************************************************/
+
+static const unsigned char *DBFGetRecord( DBFHandle psDBF, int hEntity )
+
+{
+    int		nRecordOffset;
+
+    if( hEntity < 0 || hEntity >= psDBF->nRecords )
+        return( NULL );
+
+    if( psDBF->bMapped )
+        return( psDBF->pabyMap + psDBF->nHeaderLength
+                + (size_t) psDBF->nRecordLength * hEntity );
+
+    if( psDBF->nCurrentRecord != hEntity )
+    {
+	DBFFlushRecord( psDBF );
+
+	nRecordOffset = psDBF->nRecordLength * hEntity + psDBF->nHeaderLength;
+
+	if( fseek( psDBF->fp, nRecordOffset, 0 ) != 0
+            || fread( psDBF->pszCurrentRecord, psDBF->nRecordLength,
+                      1, psDBF->fp ) != 1 )
+        {
+            psDBF->nCurrentRecord = -1;
+            return( NULL );
+        }
+
+	psDBF->nCurrentRecord = hEntity;
+    }
+
+    return( (const unsigned char *) psDBF->pszCurrentRecord );
+}
+
 /************************************************************************/
 /*                              DBFOpen()                               */
 /*                                                                      */
@@ -309,10 +349,16 @@ DBFOpen( const char * pszFilename, const char * pszAccess )
     unsigned char		*pabyBuf;
     int			nFields, nHeadLen, nRecLen, iField, i;
     char		*pszBasename, *pszFullname;
+    int			bWantMap;
 
 /* -------------------------------------------------------------------- */
-/*      We only allow the access strings "rb" and "r+".                  */
+/*      We only allow the access strings "rb" and "r+", and "rbm" for   */
+/*      a read-only handle that keeps the file memory-mapped.           */
 /* -------------------------------------------------------------------- */
+    bWantMap = strcmp(pszAccess,"rbm") == 0;
+    if( bWantMap )
+        pszAccess = "rb";
+
     if( strcmp(pszAccess,"r") != 0 && strcmp(pszAccess,"r+") != 0 
         && strcmp(pszAccess,"rb") != 0 && strcmp(pszAccess,"rb+") != 0
         && strcmp(pszAccess,"r+b") != 0 )
@@ -431,6 +477,26 @@ DBFOpen( const char * pszFilename, const char * pszAccess )
 	      psDBF->panFieldOffset[iField-1] + psDBF->panFieldSize[iField-1];
     }
 
+/* -------------------------------------------------------------------- */
+/*      Map the file if requested.  A file shorter than its header      */
+/*      claims, or one that cannot be mapped, is read through stdio.    */
+/* -------------------------------------------------------------------- */
+    if( bWantMap )
+    {
+        psDBF->pabyMap = SHPMapFile( psDBF->fp, &psDBF->nMapSize );
+
+        if( psDBF->pabyMap != NULL
+            && psDBF->nMapSize >= (size_t) nHeadLen
+                                  + (size_t) nRecLen * psDBF->nRecords )
+            psDBF->bMapped = TRUE;
+        else
+        {
+            SHPUnmapFile( psDBF->pabyMap, psDBF->nMapSize );
+            psDBF->pabyMap = NULL;
+            psDBF->nMapSize = 0;
+        }
+    }
+
     return( psDBF );
 }
 
@@ -476,6 +542,7 @@ DBFClose(DBFHandle psDBF)
 /* -------------------------------------------------------------------- */
 /*      Close, and free resources.                                      */
 /* -------------------------------------------------------------------- */
+    SHPUnmapFile( psDBF->pabyMap, psDBF->nMapSize );
     fclose( psDBF->fp );
 
     if( psDBF->panFieldOffset != NULL )
@@ -571,6 +638,10 @@ DBFCreate( const char * pszFilename )
 
     psDBF->bNoHeader = TRUE;
 
+    psDBF->bMapped = FALSE;
+    psDBF->pabyMap = NULL;
+    psDBF->nMapSize = 0;
+
     return( psDBF );
 }
 
@@ -703,9 +774,9 @@ static void *DBFReadAttribute(DBFHandle psDBF, int hEntity, int iField,
         return( NULL );
 
 /* -------------------------------------------------------------------- */
-/*	Have we read the record?					*/
+/*	Have we read the record?  A mapped file needs no read at all.	*/
 /* -------------------------------------------------------------------- */
-    if( psDBF->nCurrentRecord != hEntity )
+    if( !psDBF->bMapped && psDBF->nCurrentRecord != hEntity )
     {
 	DBFFlushRecord( psDBF );
 
@@ -729,7 +800,7 @@ static void *DBFReadAttribute(DBFHandle psDBF, int hEntity, int iField,
 	psDBF->nCurrentRecord = hEntity;
     }
 
-    pabyRec = (unsigned char *) psDBF->pszCurrentRecord;
+    pabyRec = (unsigned char *) DBFGetRecord( psDBF, hEntity );
 
 /* -------------------------------------------------------------------- */
 /*	Ensure our field buffer is large enough to hold this buffer.	*/
@@ -1361,6 +1432,12 @@ DBFReadTuple(DBFHandle psDBF, int hEntity )
     if( hEntity < 0 || hEntity >= psDBF->nRecords )
         return( NULL );
 
+/* -------------------------------------------------------------------- */
+/*      A mapped record is returned in place, without a copy.          */
+/* -------------------------------------------------------------------- */
+    if( psDBF->bMapped )
+        return( (const char *) DBFGetRecord( psDBF, hEntity ) );
+
     if( psDBF->nCurrentRecord != hEntity )
     {
 	DBFFlushRecord( psDBF );
@@ -1493,3 +1570,399 @@ DBFGetFieldIndex(DBFHandle psDBF, const char *pszFieldName)
     }
     return(-1);
 }
+
+/************************************************************************/
+/*                         DBFReadFieldSlice()                          */
+/*                                                                      */
+/*      The raw bytes of a field, without a copy when mapped.           */
+/************************************************************************/
+
+const char SHPAPI_CALL1(*)
+DBFReadFieldSlice( DBFHandle psDBF, int iRecord, int iField, int * pnLength )
+
+{
+    const unsigned char	*pabyRec;
+
+    if( iField < 0 || iField >= psDBF->nFields )
+        return( NULL );
+
+    pabyRec = DBFGetRecord( psDBF, iRecord );
+    if( pabyRec == NULL )
+        return( NULL );
+
+    if( pnLength != NULL )
+        *pnLength = psDBF->panFieldSize[iField];
+
+    return( (const char *) pabyRec + psDBF->panFieldOffset[iField] );
+}
+
+/************************************************************************/
+/*                          DBFParseNumber()                            */
+/*                                                                      */
+/*      Parse an 'N', 'F' or 'D' field in place: blanks, an optional    */
+/*      sign, digits, an optional point and digits, blanks.  Up to 15   */
+/*      digits the mantissa and the power of ten are both exact         */
+/*      doubles, so their quotient is the correctly rounded value, the  */
+/*      same atof() gives.  Longer values and exponents are left to     */
+/*      atof() on a terminated copy.  A field of blanks or asterisks    */
+/*      is null, and so is a sign or point without any digit.           */
+/************************************************************************/
+
+static double DBFParseText( const char *pachField, int nWidth, int *pbIsNull );
+
+static double DBFParseNumber( const char *pachField, int nWidth, int *pbIsNull )
+
+{
+    static const double adfPowerOfTen[16] =
+        { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+          1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+
+    long long	nMantissa = 0;
+    int		i = 0, nDigits = 0, nFraction = -1, bNegative = FALSE;
+    double	dfValue;
+
+    while( i < nWidth && pachField[i] == ' ' )
+        i++;
+
+    if( i == nWidth || pachField[i] == '\0' || pachField[i] == '*' )
+    {
+        *pbIsNull = TRUE;
+        return( 0.0 );
+    }
+
+    if( pachField[i] == '-' || pachField[i] == '+' )
+        bNegative = pachField[i++] == '-';
+
+    for( ; i < nWidth; i++ )
+    {
+        if( pachField[i] >= '0' && pachField[i] <= '9' )
+        {
+            if( ++nDigits > 15 )
+                return( DBFParseText( pachField, nWidth, pbIsNull ) );
+
+            nMantissa = nMantissa * 10 + (pachField[i] - '0');
+            if( nFraction >= 0 )
+                nFraction++;
+        }
+        else if( pachField[i] == '.' && nFraction < 0 )
+            nFraction = 0;
+        else
+            break;
+    }
+
+    while( i < nWidth && pachField[i] == ' ' )
+        i++;
+
+    if( i < nWidth && pachField[i] != '\0' )
+        return( DBFParseText( pachField, nWidth, pbIsNull ) );
+
+    if( nDigits == 0 )
+    {
+        *pbIsNull = TRUE;
+        return( 0.0 );
+    }
+
+    *pbIsNull = FALSE;
+
+    dfValue = (double) nMantissa;
+    if( nFraction > 0 )
+        dfValue /= adfPowerOfTen[nFraction];
+
+    return( bNegative ? -dfValue : dfValue );
+}
+
+/************************************************************************/
+/*                           DBFParseText()                             */
+/*                                                                      */
+/*      Any other field, or a number DBFParseNumber() cannot take, as   */
+/*      DBFReadDoubleAttribute() reads it.                              */
+/************************************************************************/
+
+static double DBFParseText( const char *pachField, int nWidth, int *pbIsNull )
+
+{
+    char	szField[256];
+    int		i;
+
+    for( i = 0; i < nWidth && pachField[i] == ' '; i++ ) {}
+    *pbIsNull = i == nWidth || pachField[i] == '\0' || pachField[i] == '*';
+
+    if( nWidth > 255 )
+        nWidth = 255;
+    memcpy( szField, pachField, nWidth );
+    szField[nWidth] = '\0';
+
+    return( atof( szField ) );
+}
+
+/************************************************************************/
+/*                         DBFParseInteger64()                          */
+/*                                                                      */
+/*      Parse an 'N', 'F' or 'D' field as a 64 bit integer, digit by    */
+/*      digit, so that values past 2^53 keep every digit.  A value      */
+/*      out of the range is null.  One written with a point or an       */
+/*      exponent is parsed as a double and truncated.                   */
+/************************************************************************/
+
+static long long DBFParseInteger64( const char *pachField, int nWidth,
+                                    int *pbIsNull )
+
+{
+    unsigned long long	nMagnitude = 0, nLimit = LLONG_MAX;
+    int		i = 0, nDigit, nDigits = 0, bNegative = FALSE;
+    double	dfValue;
+
+    while( i < nWidth && pachField[i] == ' ' )
+        i++;
+
+    if( i == nWidth || pachField[i] == '\0' || pachField[i] == '*' )
+    {
+        *pbIsNull = TRUE;
+        return( 0 );
+    }
+
+    if( pachField[i] == '-' || pachField[i] == '+' )
+        bNegative = pachField[i++] == '-';
+    if( bNegative )
+        nLimit = (unsigned long long) LLONG_MAX + 1;
+
+    for( ; i < nWidth && pachField[i] >= '0' && pachField[i] <= '9'; i++ )
+    {
+        nDigit = pachField[i] - '0';
+        if( nMagnitude > (nLimit - nDigit) / 10 )
+        {
+            *pbIsNull = TRUE;
+            return( 0 );
+        }
+
+        nMagnitude = nMagnitude * 10 + nDigit;
+        nDigits++;
+    }
+
+    while( i < nWidth && pachField[i] == ' ' )
+        i++;
+
+    if( i < nWidth && pachField[i] != '\0' )
+    {
+        dfValue = DBFParseNumber( pachField, nWidth, pbIsNull );
+        if( *pbIsNull || !(dfValue >= -9223372036854775808.0
+                           && dfValue < 9223372036854775808.0) )
+        {
+            *pbIsNull = TRUE;
+            return( 0 );
+        }
+
+        return( (long long) dfValue );
+    }
+
+    if( nDigits == 0 )
+    {
+        *pbIsNull = TRUE;
+        return( 0 );
+    }
+
+    *pbIsNull = FALSE;
+
+    if( bNegative )
+        return( nMagnitude == 0 ? 0 : -(long long) (nMagnitude - 1) - 1 );
+
+    return( (long long) nMagnitude );
+}
+
+/************************************************************************/
+/*                          DBFParseLogical()                           */
+/************************************************************************/
+
+static double DBFParseLogical( const char *pachField, int nWidth, int *pbIsNull )
+
+{
+    *pbIsNull = nWidth < 1 || pachField[0] == '?' || pachField[0] == ' ';
+
+    if( nWidth < 1 )
+        return( 0.0 );
+
+    return( pachField[0] == 'T' || pachField[0] == 't'
+            || pachField[0] == 'Y' || pachField[0] == 'y' ? 1.0 : 0.0 );
+}
+
+/************************************************************************/
+/*                        DBFReadNumberColumn()                         */
+/*                                                                      */
+/*      Parse one field of consecutive records, with the parser for     */
+/*      its type picked once for the whole column.  An integer out of   */
+/*      the int range, or not a number, is null.                        */
+/************************************************************************/
+
+static int DBFReadNumberColumn( DBFHandle psDBF, int iField, int iFirstRecord,
+                                int nCount, int * panValues,
+                                double * padfValues,
+                                unsigned char * pabyIsNull )
+
+{
+    double	(*pfnParse)( const char *, int, int * );
+    const unsigned char	*pabyRec;
+    int		i, nOffset, nWidth, bIsNull;
+    double	dfValue;
+
+    if( iField < 0 || iField >= psDBF->nFields
+        || iFirstRecord < 0 || nCount < 0 )
+        return( -1 );
+
+    if( iFirstRecord > psDBF->nRecords )
+        iFirstRecord = psDBF->nRecords;
+    if( nCount > psDBF->nRecords - iFirstRecord )
+        nCount = psDBF->nRecords - iFirstRecord;
+
+    switch( psDBF->pachFieldType[iField] )
+    {
+      case 'N':
+      case 'F':
+      case 'D':
+        pfnParse = DBFParseNumber;
+        break;
+
+      case 'L':
+        pfnParse = DBFParseLogical;
+        break;
+
+      default:
+        pfnParse = DBFParseText;
+        break;
+    }
+
+    nOffset = psDBF->panFieldOffset[iField];
+    nWidth = psDBF->panFieldSize[iField];
+
+    for( i = 0; i < nCount; i++ )
+    {
+        pabyRec = DBFGetRecord( psDBF, iFirstRecord + i );
+        if( pabyRec == NULL )
+            return( -1 );
+
+        dfValue = pfnParse( (const char *) pabyRec + nOffset, nWidth, &bIsNull );
+
+        if( panValues != NULL )
+        {
+            if( dfValue >= INT_MIN && dfValue <= INT_MAX )
+                panValues[i] = (int) dfValue;
+            else
+            {
+                panValues[i] = 0;
+                bIsNull = TRUE;
+            }
+        }
+        if( padfValues != NULL )
+            padfValues[i] = dfValue;
+        if( pabyIsNull != NULL )
+            pabyIsNull[i] = (unsigned char) bIsNull;
+    }
+
+    return( nCount );
+}
+
+/************************************************************************/
+/*                        DBFReadIntegerColumn()                        */
+/************************************************************************/
+
+int SHPAPI_CALL
+DBFReadIntegerColumn( DBFHandle psDBF, int iField, int iFirstRecord,
+                      int nCount, int * panValues, unsigned char * pabyIsNull )
+
+{
+    return( DBFReadNumberColumn( psDBF, iField, iFirstRecord, nCount,
+                                 panValues, NULL, pabyIsNull ) );
+}
+
+/************************************************************************/
+/*                       DBFReadInteger64Column()                       */
+/*                                                                      */
+/*      Number fields are parsed straight into 64 bit integers, any     */
+/*      other field as DBFReadDoubleColumn() reads it, truncated.       */
+/************************************************************************/
+
+int SHPAPI_CALL
+DBFReadInteger64Column( DBFHandle psDBF, int iField, int iFirstRecord,
+                        int nCount, long long * panValues,
+                        unsigned char * pabyIsNull )
+
+{
+    double	(*pfnParse)( const char *, int, int * ) = NULL;
+    const unsigned char	*pabyRec;
+    const char	*pachField;
+    int		i, nOffset, nWidth, bIsNull;
+    long long	nValue;
+    double	dfValue;
+
+    if( iField < 0 || iField >= psDBF->nFields
+        || iFirstRecord < 0 || nCount < 0 )
+        return( -1 );
+
+    if( iFirstRecord > psDBF->nRecords )
+        iFirstRecord = psDBF->nRecords;
+    if( nCount > psDBF->nRecords - iFirstRecord )
+        nCount = psDBF->nRecords - iFirstRecord;
+
+    switch( psDBF->pachFieldType[iField] )
+    {
+      case 'N':
+      case 'F':
+      case 'D':
+        break;
+
+      case 'L':
+        pfnParse = DBFParseLogical;
+        break;
+
+      default:
+        pfnParse = DBFParseText;
+        break;
+    }
+
+    nOffset = psDBF->panFieldOffset[iField];
+    nWidth = psDBF->panFieldSize[iField];
+
+    for( i = 0; i < nCount; i++ )
+    {
+        pabyRec = DBFGetRecord( psDBF, iFirstRecord + i );
+        if( pabyRec == NULL )
+            return( -1 );
+
+        pachField = (const char *) pabyRec + nOffset;
+
+        if( pfnParse == NULL )
+            nValue = DBFParseInteger64( pachField, nWidth, &bIsNull );
+        else
+        {
+            dfValue = pfnParse( pachField, nWidth, &bIsNull );
+            if( !bIsNull && dfValue >= -9223372036854775808.0
+                && dfValue < 9223372036854775808.0 )
+                nValue = (long long) dfValue;
+            else
+            {
+                nValue = 0;
+                bIsNull = TRUE;
+            }
+        }
+
+        if( panValues != NULL )
+            panValues[i] = nValue;
+        if( pabyIsNull != NULL )
+            pabyIsNull[i] = (unsigned char) bIsNull;
+    }
+
+    return( nCount );
+}
+
+/************************************************************************/
+/*                        DBFReadDoubleColumn()                         */
+/************************************************************************/
+
+int SHPAPI_CALL
+DBFReadDoubleColumn( DBFHandle psDBF, int iField, int iFirstRecord,
+                     int nCount, double * padfValues,
+                     unsigned char * pabyIsNull )
+
+{
+    return( DBFReadNumberColumn( psDBF, iField, iFirstRecord, nCount,
+                                 NULL, padfValues, pabyIsNull ) );
+}
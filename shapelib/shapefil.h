@@ -207,10 +207,28 @@ struct SHPInfo
 
     unsigned char *pabyRec;
     int         nBufSize;
+
+    /* read-only memory mappings, only set when opened with "rbm" */
+    int		bMapped;
+    unsigned char *pabySHPMap;
+    size_t	nSHPMapSize;
+    unsigned char *pabySHXMap;
+    size_t	nSHXMapSize;
 } ;
 
 typedef SHPInfo * SHPHandle;
 
+/* -------------------------------------------------------------------- */
+/*      SHPReadContext - a record buffer owned by the caller, for the   */
+/*      reentrant *R() readers.  Zero it before first use and release   */
+/*      it with SHPFreeReadContext().  One per thread.                  */
+/* -------------------------------------------------------------------- */
+typedef struct
+{
+    unsigned char *pabyRec;
+    int         nBufSize;
+} SHPReadContext;
+
 /* -------------------------------------------------------------------- */
 /*      Shape types (nSHPType)                                          */
 /* -------------------------------------------------------------------- */
@@ -286,6 +304,18 @@ void SHPAPI_CALL
 
 SHPObject SHPAPI_CALL1(*)
       SHPReadObject( SHPHandle hSHP, int iShape );
+int SHPAPI_CALL
+      SHPReadObjectBounds( SHPHandle hSHP, int iShape,
+                           double * padfBoundsMin, double * padfBoundsMax );
+const unsigned char SHPAPI_CALL1(*)
+      SHPReadRecordBytes( SHPHandle hSHP, int iShape, int * pnBytes );
+SHPObject SHPAPI_CALL1(*)
+      SHPReadObjectR( SHPHandle hSHP, int iShape, SHPReadContext * psContext );
+const unsigned char SHPAPI_CALL1(*)
+      SHPReadRecordBytesR( SHPHandle hSHP, int iShape,
+                           SHPReadContext * psContext, int * pnBytes );
+void SHPAPI_CALL
+      SHPFreeReadContext( SHPReadContext * psContext );
 int SHPAPI_CALL
       SHPWriteObject( SHPHandle hSHP, int iShape, SHPObject * psObject );
 
@@ -313,6 +343,11 @@ const char SHPAPI_CALL1(*)
 const char SHPAPI_CALL1(*)
       SHPPartTypeName( int nPartType );
 
+unsigned char SHPAPI_CALL1(*)
+      SHPMapFile( FILE * fp, size_t * pnSize );
+void SHPAPI_CALL
+      SHPUnmapFile( unsigned char * pabyMap, size_t nSize );
+
 /* -------------------------------------------------------------------- */
 /*      Shape quadtree indexing API.                                    */
 /* -------------------------------------------------------------------- */
@@ -364,6 +399,11 @@ int	SHPAPI_CALL
       SHPTreeAddShapeId( SHPTree * hTree, SHPObject * psObject );
 int	SHPAPI_CALL
       SHPTreeRemoveShapeId( SHPTree * hTree, int nShapeId );
+int	SHPAPI_CALL
+      SHPTreeAddShapeBounds( SHPTree * hTree, int nShapeId,
+                             double * padfBoundsMin, double * padfBoundsMax );
+void	SHPAPI_CALL
+      SHPTreeMerge( SHPTree * hTarget, SHPTree * hSource );
 
 void 	SHPAPI_CALL
       SHPTreeTrimExtraNodes( SHPTree * hTree );
@@ -376,6 +416,74 @@ int    SHPAPI_CALL1(*)
 int     SHPAPI_CALL
       SHPCheckBoundsOverlap( double *, double *, double *, double *, int );
 
+/* -------------------------------------------------------------------- */
+/*      Allocation free variants of the searches above: the shapeids    */
+/*      of every overlapping node are passed to the callback, one       */
+/*      node at a time and in tree order rather than sorted.            */
+/* -------------------------------------------------------------------- */
+typedef void (*SHPTreeVisitFunc)( const int * panShapeIds, int nShapeCount,
+                                  void * pUserData );
+
+void	SHPAPI_CALL
+      SHPTreeVisitLikelyShapes( SHPTree * hTree,
+                                double * padfBoundsMin,
+                                double * padfBoundsMax,
+                                SHPTreeVisitFunc pfnVisit, void * pUserData );
+
+/* -------------------------------------------------------------------- */
+/*      Flattened quadtree that can be saved next to the shapefile      */
+/*      (.sqt) and mapped back in on the next open.  The nodes are      */
+/*      stored breadth first so the subnodes of a node are              */
+/*      contiguous.  The source stamps (usually .shp size and           */
+/*      modification time) are stored in the file, and a file whose     */
+/*      stamps, byte order or version differ is treated as stale.       */
+/* -------------------------------------------------------------------- */
+typedef struct
+{
+    double	adfBoundsMin[2];
+    double	adfBoundsMax[2];
+
+    int		nShapeIdStart;		/* into panShapeIds */
+    int		nShapeCount;
+
+    int		nSubNodeStart;		/* into pasNodes */
+    int		nSubNodes;
+} SHPDiskTreeNode;
+
+typedef struct
+{
+    unsigned char *pabyData;
+    size_t	nDataSize;
+
+    int		nRecords;
+
+    int		nNodes;
+    const SHPDiskTreeNode *pasNodes;
+
+    int		nShapeIds;
+    const int	*panShapeIds;
+} SHPDiskTree;
+
+int	SHPAPI_CALL
+      SHPWriteDiskTree( SHPTree * hTree, const char * pszFilename,
+                        double dfSourceSize, double dfSourceTime );
+SHPDiskTree SHPAPI_CALL1(*)
+      SHPOpenDiskTree( const char * pszFilename, int nRecords,
+                       double dfSourceSize, double dfSourceTime );
+void	SHPAPI_CALL
+      SHPCloseDiskTree( SHPDiskTree * hDiskTree );
+int    SHPAPI_CALL1(*)
+      SHPDiskTreeFindLikelyShapes( SHPDiskTree * hDiskTree,
+                                   double * padfBoundsMin,
+                                   double * padfBoundsMax,
+                                   int * );
+void	SHPAPI_CALL
+      SHPDiskTreeVisitLikelyShapes( SHPDiskTree * hDiskTree,
+                                    double * padfBoundsMin,
+                                    double * padfBoundsMax,
+                                    SHPTreeVisitFunc pfnVisit,
+                                    void * pUserData );
+
 /************************************************************************/
 /*                             DBF Support.                             */
 /************************************************************************/
@@ -401,6 +509,11 @@ struct DBFInfo
     
     int		bNoHeader;
     int		bUpdated;
+
+    /* read-only memory mapping, only set when opened with "rbm" */
+    int		bMapped;
+    unsigned char *pabyMap;
+    size_t	nMapSize;
 } ;
 
 typedef DBFInfo * DBFHandle;
@@ -466,6 +579,31 @@ int SHPAPI_CALL
                                void * pValue );
 const char SHPAPI_CALL1(*)
       DBFReadTuple(DBFHandle psDBF, int hEntity );
+
+/* -------------------------------------------------------------------- */
+/*      Raw field access.  DBFReadFieldSlice() points at the fixed      */
+/*      width bytes of a field, not terminated and not trimmed,         */
+/*      straight into the mapping of a handle opened with "rbm" and     */
+/*      into the current record buffer otherwise.  The column readers   */
+/*      parse nCount consecutive records of one field by its type,      */
+/*      flagging the null ones in pabyIsNull if not NULL, and return    */
+/*      the number of records read or -1.                               */
+/* -------------------------------------------------------------------- */
+const char SHPAPI_CALL1(*)
+      DBFReadFieldSlice( DBFHandle psDBF, int iRecord, int iField,
+                         int * pnLength );
+int SHPAPI_CALL
+      DBFReadIntegerColumn( DBFHandle psDBF, int iField, int iFirstRecord,
+                            int nCount, int * panValues,
+                            unsigned char * pabyIsNull );
+int SHPAPI_CALL
+      DBFReadInteger64Column( DBFHandle psDBF, int iField, int iFirstRecord,
+                              int nCount, long long * panValues,
+                              unsigned char * pabyIsNull );
+int SHPAPI_CALL
+      DBFReadDoubleColumn( DBFHandle psDBF, int iField, int iFirstRecord,
+                           int nCount, double * padfValues,
+                           unsigned char * pabyIsNull );
 int SHPAPI_CALL
       DBFWriteTuple(DBFHandle psDBF, int hEntity, void * pRawTuple );
 
@@ -169,6 +169,16 @@ static char rcsid[] =
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#  include <windows.h>
+#  include <io.h>
+#else
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
 typedef unsigned char uchar;
 
 #if UINT_MAX == 65535
@@ -188,7 +198,22 @@ typedef int	      int32;
 #  define MAX(a,b)      ((a>b) ? a : b)
 #endif
 
-static int 	bBigEndian;
+/* -------------------------------------------------------------------- */
+/*      The byte order of this machine, established once at startup    */
+/*      rather than by every SHPOpen(), as handles may be opened from   */
+/*      several threads at once.                                        */
+/* -------------------------------------------------------------------- */
+static int SHPIsBigEndian()
+{
+    int i = 1;
+
+    return *((uchar *) &i) == 1 ? FALSE : TRUE;
+}
+
+static const int bBigEndian = SHPIsBigEndian();
+
+static SHPObject *SHPDecodeObject( SHPHandle psSHP, int hEntity,
+                                   const uchar * pabyRec );
 
 
 /************************************************************************/
@@ -227,6 +252,123 @@ static void * SfRealloc( void * pMem, int nNewSize )
         return( (void *) realloc(pMem,nNewSize) );
 }
 
+/************************************************************************/
+/*                             SHPReadAt()                              */
+/*                                                                      */
+/*      Read nBytes at nOffset of the .shp without touching the         */
+/*      shared stdio position, so several threads may call it on        */
+/*      one handle at once.  Returns FALSE on a short read.             */
+/************************************************************************/
+
+static int SHPReadAt( SHPHandle psSHP, int nOffset, void * pBuffer,
+                      int nBytes )
+
+{
+#ifdef _WIN32
+    HANDLE		hFile;
+    OVERLAPPED		sOverlapped;
+    DWORD		nRead = 0;
+
+    hFile = (HANDLE) _get_osfhandle( _fileno(psSHP->fpSHP) );
+    if( hFile == INVALID_HANDLE_VALUE )
+        return FALSE;
+
+    memset( &sOverlapped, 0, sizeof(sOverlapped) );
+    sOverlapped.Offset = (DWORD) nOffset;
+
+    return ReadFile( hFile, pBuffer, (DWORD) nBytes, &nRead, &sOverlapped )
+        && nRead == (DWORD) nBytes;
+#else
+    uchar		*pabyBuffer = (uchar *) pBuffer;
+    ssize_t		nRead;
+
+    while( nBytes > 0 )
+    {
+        nRead = pread( fileno(psSHP->fpSHP), pabyBuffer, (size_t) nBytes,
+                       (off_t) nOffset );
+        if( nRead <= 0 )
+            return FALSE;
+
+        pabyBuffer += nRead;
+        nOffset += (int) nRead;
+        nBytes -= (int) nRead;
+    }
+
+    return TRUE;
+#endif
+}
+
+/************************************************************************/
+/*                            SHPMapFile()                              */
+/*                                                                      */
+/*      Map a whole open file read-only.  Returns NULL if the file is   */
+/*      empty or the platform refuses, in which case the caller         */
+/*      keeps using stdio.  Also used by the tree and DBF readers.      */
+/************************************************************************/
+
+unsigned char SHPAPI_CALL1(*)
+SHPMapFile( FILE * fp, size_t * pnSize )
+
+{
+#ifdef _WIN32
+    HANDLE		hFile, hMapping;
+    LARGE_INTEGER	nSize;
+    void		*pMap;
+
+    hFile = (HANDLE) _get_osfhandle( _fileno(fp) );
+    if( hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx( hFile, &nSize )
+        || nSize.QuadPart == 0 )
+        return( NULL );
+
+    hMapping = CreateFileMapping( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( hMapping == NULL )
+        return( NULL );
+
+    /* the view keeps the mapping object alive on its own */
+    pMap = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle( hMapping );
+
+    if( pMap == NULL )
+        return( NULL );
+
+    *pnSize = (size_t) nSize.QuadPart;
+    return( (uchar *) pMap );
+#else
+    struct stat		sStat;
+    void		*pMap;
+
+    if( fstat( fileno(fp), &sStat ) != 0 || sStat.st_size <= 0 )
+        return( NULL );
+
+    pMap = mmap( NULL, (size_t) sStat.st_size, PROT_READ, MAP_SHARED,
+                 fileno(fp), 0 );
+    if( pMap == MAP_FAILED )
+        return( NULL );
+
+    *pnSize = (size_t) sStat.st_size;
+    return( (uchar *) pMap );
+#endif
+}
+
+/************************************************************************/
+/*                           SHPUnmapFile()                             */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPUnmapFile( unsigned char * pabyMap, size_t nSize )
+
+{
+    if( pabyMap == NULL )
+        return;
+
+#ifdef _WIN32
+    (void) nSize;
+    UnmapViewOfFile( pabyMap );
+#else
+    munmap( pabyMap, nSize );
+#endif
+}
+
 /************************************************************************/
 /*                          SHPWriteHeader()                            */
 /*                                                                      */
@@ -345,29 +487,24 @@ SHPOpen( const char * pszLayer, const char * pszAccess )
     SHPHandle		psSHP;
     
     uchar		*pabyBuf;
-    int			i;
+    int			i, bWantMap, bBufMapped;
     double		dValue;
     
 /* -------------------------------------------------------------------- */
 /*      Ensure the access string is one of the legal ones.  We          */
 /*      ensure the result string indicates binary to avoid common       */
-/*      problems on Windows.                                            */
+/*      problems on Windows.  An 'm' (as in "rbm") asks for a           */
+/*      read-only handle that keeps both files memory-mapped.           */
 /* -------------------------------------------------------------------- */
-    if( strcmp(pszAccess,"rb+") == 0 || strcmp(pszAccess,"r+b") == 0
-        || strcmp(pszAccess,"r+") == 0 )
+    bWantMap = strchr(pszAccess,'m') != NULL;
+
+    if( !bWantMap
+        && (strcmp(pszAccess,"rb+") == 0 || strcmp(pszAccess,"r+b") == 0
+            || strcmp(pszAccess,"r+") == 0) )
         pszAccess = "r+b";
     else
         pszAccess = "rb";
     
-/* -------------------------------------------------------------------- */
-/*	Establish the byte order on this machine.			*/
-/* -------------------------------------------------------------------- */
-    i = 1;
-    if( *((uchar *) &i) == 1 )
-        bBigEndian = FALSE;
-    else
-        bBigEndian = TRUE;
-
 /* -------------------------------------------------------------------- */
 /*	Initialize the info structure.					*/
 /* -------------------------------------------------------------------- */
@@ -430,6 +567,26 @@ SHPOpen( const char * pszLayer, const char * pszAccess )
     free( pszFullname );
     free( pszBasename );
 
+/* -------------------------------------------------------------------- */
+/*      Map both files if requested.  Failing that we silently fall     */
+/*      back to stdio reads, which behave identically.                  */
+/* -------------------------------------------------------------------- */
+    if( bWantMap )
+    {
+        psSHP->pabySHPMap = SHPMapFile( psSHP->fpSHP, &psSHP->nSHPMapSize );
+        psSHP->pabySHXMap = SHPMapFile( psSHP->fpSHX, &psSHP->nSHXMapSize );
+
+        if( psSHP->pabySHPMap != NULL && psSHP->pabySHXMap != NULL )
+            psSHP->bMapped = TRUE;
+        else
+        {
+            SHPUnmapFile( psSHP->pabySHPMap, psSHP->nSHPMapSize );
+            SHPUnmapFile( psSHP->pabySHXMap, psSHP->nSHXMapSize );
+            psSHP->pabySHPMap = psSHP->pabySHXMap = NULL;
+            psSHP->nSHPMapSize = psSHP->nSHXMapSize = 0;
+        }
+    }
+
 /* -------------------------------------------------------------------- */
 /*  Read the file size from the SHP file.				*/
 /* -------------------------------------------------------------------- */
@@ -451,9 +608,12 @@ SHPOpen( const char * pszLayer, const char * pszAccess )
         || pabyBuf[2] != 0x27 
         || (pabyBuf[3] != 0x0a && pabyBuf[3] != 0x0d) )
     {
+        SHPUnmapFile( psSHP->pabySHPMap, psSHP->nSHPMapSize );
+        SHPUnmapFile( psSHP->pabySHXMap, psSHP->nSHXMapSize );
 	fclose( psSHP->fpSHP );
 	fclose( psSHP->fpSHX );
 	free( psSHP );
+	free( pabyBuf );
 
 	return( NULL );
     }
@@ -467,9 +627,12 @@ SHPOpen( const char * pszLayer, const char * pszAccess )
     if( psSHP->nRecords < 0 || psSHP->nRecords > 256000000 )
     {
         /* this header appears to be corrupt.  Give up. */
+        SHPUnmapFile( psSHP->pabySHPMap, psSHP->nSHPMapSize );
+        SHPUnmapFile( psSHP->pabySHXMap, psSHP->nSHXMapSize );
 	fclose( psSHP->fpSHP );
 	fclose( psSHP->fpSHX );
 	free( psSHP );
+	free( pabyBuf );
 
 	return( NULL );
     }
@@ -522,8 +685,17 @@ SHPOpen( const char * pszLayer, const char * pszAccess )
     psSHP->panRecSize =
         (int *) malloc(sizeof(int) * MAX(1,psSHP->nMaxRecords) );
 
-    pabyBuf = (uchar *) malloc(8 * MAX(1,psSHP->nRecords) );
-    fread( pabyBuf, 8, psSHP->nRecords, psSHP->fpSHX );
+    bBufMapped = psSHP->bMapped
+        && psSHP->nSHXMapSize >= 100 + 8 * (size_t) psSHP->nRecords;
+
+    if( bBufMapped )
+        pabyBuf = psSHP->pabySHXMap + 100;
+    else
+    {
+        pabyBuf = (uchar *) malloc(8 * MAX(1,psSHP->nRecords) );
+        fseek( psSHP->fpSHX, 100, 0 );
+        fread( pabyBuf, 8, psSHP->nRecords, psSHP->fpSHX );
+    }
 
     for( i = 0; i < psSHP->nRecords; i++ )
     {
@@ -538,7 +710,9 @@ SHPOpen( const char * pszLayer, const char * pszAccess )
 	psSHP->panRecOffset[i] = nOffset*2;
 	psSHP->panRecSize[i] = nLength*2;
     }
-    free( pabyBuf );
+
+    if( !bBufMapped )
+        free( pabyBuf );
 
     return( psSHP );
 }
@@ -567,6 +741,9 @@ SHPClose(SHPHandle psSHP )
     free( psSHP->panRecOffset );
     free( psSHP->panRecSize );
 
+    SHPUnmapFile( psSHP->pabySHPMap, psSHP->nSHPMapSize );
+    SHPUnmapFile( psSHP->pabySHXMap, psSHP->nSHXMapSize );
+
     fclose( psSHP->fpSHX );
     fclose( psSHP->fpSHP );
 
@@ -624,15 +801,6 @@ SHPCreate( const char * pszLayer, int nShapeType )
     int32	i32;
     double	dValue;
     
-/* -------------------------------------------------------------------- */
-/*      Establish the byte order on this system.                        */
-/* -------------------------------------------------------------------- */
-    i = 1;
-    if( *((uchar *) &i) == 1 )
-        bBigEndian = FALSE;
-    else
-        bBigEndian = TRUE;
-
 /* -------------------------------------------------------------------- */
 /*	Compute the base (layer) name.  If there is any extension	*/
 /*	on the passed in filename we will strip it off.			*/
@@ -1266,17 +1434,20 @@ SHPWriteObject(SHPHandle psSHP, int nShapeId, SHPObject * psObject )
 }
 
 /************************************************************************/
-/*                          SHPReadObject()                             */
+/*                         SHPReadRecordBytes()                         */
 /*                                                                      */
-/*      Read the vertices, parts, and other non-attribute information	*/
-/*	for one shape.							*/
+/*      Return the raw bytes of one record, including the 8 byte        */
+/*      record header.  For a mapped handle this points straight        */
+/*      into the .shp mapping and stays valid until SHPClose(),         */
+/*      otherwise it is the handle's record buffer and is only valid    */
+/*      until the next read.                                            */
 /************************************************************************/
 
-SHPObject SHPAPI_CALL1(*)
-SHPReadObject( SHPHandle psSHP, int hEntity )
+const unsigned char SHPAPI_CALL1(*)
+SHPReadRecordBytes( SHPHandle psSHP, int hEntity, int * pnBytes )
 
 {
-    SHPObject		*psShape;
+    int		nBytes;
 
 /* -------------------------------------------------------------------- */
 /*      Validate the record/entity number.                              */
@@ -1284,12 +1455,29 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
     if( hEntity < 0 || hEntity >= psSHP->nRecords )
         return( NULL );
 
+    nBytes = psSHP->panRecSize[hEntity]+8;
+    if( pnBytes != NULL )
+        *pnBytes = nBytes;
+
+/* -------------------------------------------------------------------- */
+/*      A mapped file needs no copy at all, just a range check.         */
+/* -------------------------------------------------------------------- */
+    if( psSHP->bMapped )
+    {
+        if( psSHP->panRecOffset[hEntity] < 0
+            || (size_t) psSHP->panRecOffset[hEntity] + nBytes
+               > psSHP->nSHPMapSize )
+            return( NULL );
+
+        return( psSHP->pabySHPMap + psSHP->panRecOffset[hEntity] );
+    }
+
 /* -------------------------------------------------------------------- */
 /*      Ensure our record buffer is large enough.                       */
 /* -------------------------------------------------------------------- */
-    if( psSHP->panRecSize[hEntity]+8 > psSHP->nBufSize )
+    if( nBytes > psSHP->nBufSize )
     {
-	psSHP->nBufSize = psSHP->panRecSize[hEntity]+8;
+	psSHP->nBufSize = nBytes;
 	psSHP->pabyRec = (uchar *) SfRealloc(psSHP->pabyRec,psSHP->nBufSize);
     }
 
@@ -1297,7 +1485,211 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /*      Read the record.                                                */
 /* -------------------------------------------------------------------- */
     fseek( psSHP->fpSHP, psSHP->panRecOffset[hEntity], 0 );
-    fread( psSHP->pabyRec, psSHP->panRecSize[hEntity]+8, 1, psSHP->fpSHP );
+    fread( psSHP->pabyRec, nBytes, 1, psSHP->fpSHP );
+
+    return( psSHP->pabyRec );
+}
+
+/************************************************************************/
+/*                         SHPReadRecordBytesR()                        */
+/*                                                                      */
+/*      Reentrant SHPReadRecordBytes().  A handle that is not mapped    */
+/*      reads with a positioned read into the caller's context          */
+/*      instead of the handle's buffer, so any number of threads may    */
+/*      read one handle at once, each with its own context.  The        */
+/*      bytes stay valid until the next read through that context.      */
+/*      Writes still pending in the handle's stdio buffer are not       */
+/*      seen, flush them first on a handle opened for update.           */
+/************************************************************************/
+
+const unsigned char SHPAPI_CALL1(*)
+SHPReadRecordBytesR( SHPHandle psSHP, int hEntity,
+                     SHPReadContext * psContext, int * pnBytes )
+
+{
+    int		nBytes;
+
+    if( hEntity < 0 || hEntity >= psSHP->nRecords )
+        return( NULL );
+
+    if( psSHP->bMapped )
+        return( SHPReadRecordBytes( psSHP, hEntity, pnBytes ) );
+
+    nBytes = psSHP->panRecSize[hEntity]+8;
+    if( pnBytes != NULL )
+        *pnBytes = nBytes;
+
+    if( nBytes > psContext->nBufSize )
+    {
+	psContext->nBufSize = nBytes;
+	psContext->pabyRec = (uchar *)
+            SfRealloc(psContext->pabyRec,psContext->nBufSize);
+    }
+
+    if( !SHPReadAt( psSHP, psSHP->panRecOffset[hEntity],
+                    psContext->pabyRec, nBytes ) )
+        return( NULL );
+
+    return( psContext->pabyRec );
+}
+
+/************************************************************************/
+/*                         SHPFreeReadContext()                         */
+/*                                                                      */
+/*      Release the buffer of a context, which may be used again.       */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPFreeReadContext( SHPReadContext * psContext )
+
+{
+    if( psContext->pabyRec != NULL )
+        free( psContext->pabyRec );
+
+    psContext->pabyRec = NULL;
+    psContext->nBufSize = 0;
+}
+
+/************************************************************************/
+/*                        SHPReadObjectBounds()                         */
+/*                                                                      */
+/*      Fetch only the X/Y extents of one shape from its record         */
+/*      header, without decoding any vertices.  Returns FALSE for       */
+/*      null or unreadable shapes.  Reentrant, a handle that is not     */
+/*      mapped reads the header with a positioned read.                 */
+/************************************************************************/
+
+int SHPAPI_CALL
+SHPReadObjectBounds( SHPHandle psSHP, int hEntity,
+                     double * padfBoundsMin, double * padfBoundsMax )
+
+{
+    uchar		abyLocal[36];
+    const uchar		*pabyHead;
+    int32		nSHPType;
+    double		adfBox[4];
+    int			i;
+
+    if( hEntity < 0 || hEntity >= psSHP->nRecords
+        || psSHP->panRecSize[hEntity] < 4 )
+        return FALSE;
+
+/* -------------------------------------------------------------------- */
+/*      We need the shape type and at most the 32 bytes of the box.     */
+/* -------------------------------------------------------------------- */
+    if( psSHP->bMapped )
+    {
+        if( psSHP->panRecOffset[hEntity] < 0
+            || (size_t) psSHP->panRecOffset[hEntity] + 8
+               + MIN(36,psSHP->panRecSize[hEntity]) > psSHP->nSHPMapSize )
+            return FALSE;
+
+        pabyHead = psSHP->pabySHPMap + psSHP->panRecOffset[hEntity] + 8;
+    }
+    else
+    {
+        if( !SHPReadAt( psSHP, psSHP->panRecOffset[hEntity] + 8, abyLocal,
+                        MIN(36,psSHP->panRecSize[hEntity]) ) )
+            return FALSE;
+
+        pabyHead = abyLocal;
+    }
+
+    memcpy( &nSHPType, pabyHead, 4 );
+    if( bBigEndian ) SwapWord( 4, &nSHPType );
+
+/* -------------------------------------------------------------------- */
+/*      Points carry no box, their extent is the vertex itself.         */
+/* -------------------------------------------------------------------- */
+    if( nSHPType == SHPT_POINT || nSHPType == SHPT_POINTZ
+        || nSHPType == SHPT_POINTM )
+    {
+        if( psSHP->panRecSize[hEntity] < 20 )
+            return FALSE;
+
+        for( i = 0; i < 2; i++ )
+        {
+            memcpy( adfBox + i, pabyHead + 4 + i * 8, 8 );
+            if( bBigEndian ) SwapWord( 8, adfBox + i );
+        }
+
+        padfBoundsMin[0] = padfBoundsMax[0] = adfBox[0];
+        padfBoundsMin[1] = padfBoundsMax[1] = adfBox[1];
+        return TRUE;
+    }
+
+    if( nSHPType == SHPT_NULL || psSHP->panRecSize[hEntity] < 36 )
+        return FALSE;
+
+    for( i = 0; i < 4; i++ )
+    {
+        memcpy( adfBox + i, pabyHead + 4 + i * 8, 8 );
+        if( bBigEndian ) SwapWord( 8, adfBox + i );
+    }
+
+    padfBoundsMin[0] = adfBox[0];
+    padfBoundsMin[1] = adfBox[1];
+    padfBoundsMax[0] = adfBox[2];
+    padfBoundsMax[1] = adfBox[3];
+    return TRUE;
+}
+
+/************************************************************************/
+/*                          SHPReadObject()                             */
+/*                                                                      */
+/*      Read the vertices, parts, and other non-attribute information	*/
+/*	for one shape.							*/
+/************************************************************************/
+
+SHPObject SHPAPI_CALL1(*)
+SHPReadObject( SHPHandle psSHP, int hEntity )
+
+{
+    const uchar		*pabyRec;
+
+/* -------------------------------------------------------------------- */
+/*      Locate the record bytes, either directly in the mapping or      */
+/*      read into our record buffer.                                    */
+/* -------------------------------------------------------------------- */
+    pabyRec = SHPReadRecordBytes( psSHP, hEntity, NULL );
+    if( pabyRec == NULL )
+        return( NULL );
+
+    return( SHPDecodeObject( psSHP, hEntity, pabyRec ) );
+}
+
+/************************************************************************/
+/*                          SHPReadObjectR()                            */
+/*                                                                      */
+/*      Reentrant SHPReadObject(), reading through the caller's         */
+/*      context as SHPReadRecordBytesR() does.                          */
+/************************************************************************/
+
+SHPObject SHPAPI_CALL1(*)
+SHPReadObjectR( SHPHandle psSHP, int hEntity, SHPReadContext * psContext )
+
+{
+    const uchar		*pabyRec;
+
+    pabyRec = SHPReadRecordBytesR( psSHP, hEntity, psContext, NULL );
+    if( pabyRec == NULL )
+        return( NULL );
+
+    return( SHPDecodeObject( psSHP, hEntity, pabyRec ) );
+}
+
+/************************************************************************/
+/*                          SHPDecodeObject()                           */
+/*                                                                      */
+/*      Build the object for one record from its raw bytes, header      */
+/*      included.  Only reads the handle's record table.                */
+/************************************************************************/
+
+static SHPObject *SHPDecodeObject( SHPHandle psSHP, int hEntity,
+                                   const uchar * pabyRec )
+
+{
+    SHPObject		*psShape;
 
 /* -------------------------------------------------------------------- */
 /*	Allocate and minimally initialize the object.			*/
@@ -1305,7 +1697,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
     psShape = (SHPObject *) calloc(1,sizeof(SHPObject));
     psShape->nShapeId = hEntity;
 
-    memcpy( &psShape->nSHPType, psSHP->pabyRec + 8, 4 );
+    memcpy( &psShape->nSHPType, pabyRec + 8, 4 );
     if( bBigEndian ) SwapWord( 4, &(psShape->nSHPType) );
 
 /* ==================================================================== */
@@ -1324,10 +1716,10 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
 /*	Get the X/Y bounds.						*/
 /* -------------------------------------------------------------------- */
-        memcpy( &(psShape->dfXMin), psSHP->pabyRec + 8 +  4, 8 );
-        memcpy( &(psShape->dfYMin), psSHP->pabyRec + 8 + 12, 8 );
-        memcpy( &(psShape->dfXMax), psSHP->pabyRec + 8 + 20, 8 );
-        memcpy( &(psShape->dfYMax), psSHP->pabyRec + 8 + 28, 8 );
+        memcpy( &(psShape->dfXMin), pabyRec + 8 +  4, 8 );
+        memcpy( &(psShape->dfYMin), pabyRec + 8 + 12, 8 );
+        memcpy( &(psShape->dfXMax), pabyRec + 8 + 20, 8 );
+        memcpy( &(psShape->dfYMax), pabyRec + 8 + 28, 8 );
 
 	if( bBigEndian ) SwapWord( 8, &(psShape->dfXMin) );
 	if( bBigEndian ) SwapWord( 8, &(psShape->dfYMin) );
@@ -1338,8 +1730,8 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /*      Extract part/point count, and build vertex and part arrays      */
 /*      to proper size.                                                 */
 /* -------------------------------------------------------------------- */
-	memcpy( &nPoints, psSHP->pabyRec + 40 + 8, 4 );
-	memcpy( &nParts, psSHP->pabyRec + 36 + 8, 4 );
+	memcpy( &nPoints, pabyRec + 40 + 8, 4 );
+	memcpy( &nParts, pabyRec + 36 + 8, 4 );
 
 	if( bBigEndian ) SwapWord( 4, &nPoints );
 	if( bBigEndian ) SwapWord( 4, &nParts );
@@ -1360,7 +1752,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
 /*      Copy out the part array from the record.                        */
 /* -------------------------------------------------------------------- */
-	memcpy( psShape->panPartStart, psSHP->pabyRec + 44 + 8, 4 * nParts );
+	memcpy( psShape->panPartStart, pabyRec + 44 + 8, 4 * nParts );
 	for( i = 0; i < nParts; i++ )
 	{
 	    if( bBigEndian ) SwapWord( 4, psShape->panPartStart+i );
@@ -1373,7 +1765,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
         if( psShape->nSHPType == SHPT_MULTIPATCH )
         {
-            memcpy( psShape->panPartType, psSHP->pabyRec + nOffset, 4*nParts );
+            memcpy( psShape->panPartType, pabyRec + nOffset, 4*nParts );
             for( i = 0; i < nParts; i++ )
             {
                 if( bBigEndian ) SwapWord( 4, psShape->panPartType+i );
@@ -1388,11 +1780,11 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 	for( i = 0; i < nPoints; i++ )
 	{
 	    memcpy(psShape->padfX + i,
-		   psSHP->pabyRec + nOffset + i * 16,
+		   pabyRec + nOffset + i * 16,
 		   8 );
 
 	    memcpy(psShape->padfY + i,
-		   psSHP->pabyRec + nOffset + i * 16 + 8,
+		   pabyRec + nOffset + i * 16 + 8,
 		   8 );
 
 	    if( bBigEndian ) SwapWord( 8, psShape->padfX + i );
@@ -1408,8 +1800,8 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
             || psShape->nSHPType == SHPT_ARCZ
             || psShape->nSHPType == SHPT_MULTIPATCH )
         {
-            memcpy( &(psShape->dfZMin), psSHP->pabyRec + nOffset, 8 );
-            memcpy( &(psShape->dfZMax), psSHP->pabyRec + nOffset + 8, 8 );
+            memcpy( &(psShape->dfZMin), pabyRec + nOffset, 8 );
+            memcpy( &(psShape->dfZMax), pabyRec + nOffset + 8, 8 );
             
             if( bBigEndian ) SwapWord( 8, &(psShape->dfZMin) );
             if( bBigEndian ) SwapWord( 8, &(psShape->dfZMax) );
@@ -1417,7 +1809,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
             for( i = 0; i < nPoints; i++ )
             {
                 memcpy( psShape->padfZ + i,
-                        psSHP->pabyRec + nOffset + 16 + i*8, 8 );
+                        pabyRec + nOffset + 16 + i*8, 8 );
                 if( bBigEndian ) SwapWord( 8, psShape->padfZ + i );
             }
 
@@ -1432,8 +1824,8 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
         if( psSHP->panRecSize[hEntity]+8 >= nOffset + 16 + 8*nPoints )
         {
-            memcpy( &(psShape->dfMMin), psSHP->pabyRec + nOffset, 8 );
-            memcpy( &(psShape->dfMMax), psSHP->pabyRec + nOffset + 8, 8 );
+            memcpy( &(psShape->dfMMin), pabyRec + nOffset, 8 );
+            memcpy( &(psShape->dfMMax), pabyRec + nOffset + 8, 8 );
             
             if( bBigEndian ) SwapWord( 8, &(psShape->dfMMin) );
             if( bBigEndian ) SwapWord( 8, &(psShape->dfMMax) );
@@ -1441,7 +1833,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
             for( i = 0; i < nPoints; i++ )
             {
                 memcpy( psShape->padfM + i,
-                        psSHP->pabyRec + nOffset + 16 + i*8, 8 );
+                        pabyRec + nOffset + 16 + i*8, 8 );
                 if( bBigEndian ) SwapWord( 8, psShape->padfM + i );
             }
         }
@@ -1458,7 +1850,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 	int32		nPoints;
 	int    		i, nOffset;
 
-	memcpy( &nPoints, psSHP->pabyRec + 44, 4 );
+	memcpy( &nPoints, pabyRec + 44, 4 );
 	if( bBigEndian ) SwapWord( 4, &nPoints );
 
 	psShape->nVertices = nPoints;
@@ -1469,8 +1861,8 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 
 	for( i = 0; i < nPoints; i++ )
 	{
-	    memcpy(psShape->padfX+i, psSHP->pabyRec + 48 + 16 * i, 8 );
-	    memcpy(psShape->padfY+i, psSHP->pabyRec + 48 + 16 * i + 8, 8 );
+	    memcpy(psShape->padfX+i, pabyRec + 48 + 16 * i, 8 );
+	    memcpy(psShape->padfY+i, pabyRec + 48 + 16 * i + 8, 8 );
 
 	    if( bBigEndian ) SwapWord( 8, psShape->padfX + i );
 	    if( bBigEndian ) SwapWord( 8, psShape->padfY + i );
@@ -1481,10 +1873,10 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
 /*	Get the X/Y bounds.						*/
 /* -------------------------------------------------------------------- */
-        memcpy( &(psShape->dfXMin), psSHP->pabyRec + 8 +  4, 8 );
-        memcpy( &(psShape->dfYMin), psSHP->pabyRec + 8 + 12, 8 );
-        memcpy( &(psShape->dfXMax), psSHP->pabyRec + 8 + 20, 8 );
-        memcpy( &(psShape->dfYMax), psSHP->pabyRec + 8 + 28, 8 );
+        memcpy( &(psShape->dfXMin), pabyRec + 8 +  4, 8 );
+        memcpy( &(psShape->dfYMin), pabyRec + 8 + 12, 8 );
+        memcpy( &(psShape->dfXMax), pabyRec + 8 + 20, 8 );
+        memcpy( &(psShape->dfYMax), pabyRec + 8 + 28, 8 );
 
 	if( bBigEndian ) SwapWord( 8, &(psShape->dfXMin) );
 	if( bBigEndian ) SwapWord( 8, &(psShape->dfYMin) );
@@ -1496,8 +1888,8 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
         if( psShape->nSHPType == SHPT_MULTIPOINTZ )
         {
-            memcpy( &(psShape->dfZMin), psSHP->pabyRec + nOffset, 8 );
-            memcpy( &(psShape->dfZMax), psSHP->pabyRec + nOffset + 8, 8 );
+            memcpy( &(psShape->dfZMin), pabyRec + nOffset, 8 );
+            memcpy( &(psShape->dfZMax), pabyRec + nOffset + 8, 8 );
             
             if( bBigEndian ) SwapWord( 8, &(psShape->dfZMin) );
             if( bBigEndian ) SwapWord( 8, &(psShape->dfZMax) );
@@ -1505,7 +1897,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
             for( i = 0; i < nPoints; i++ )
             {
                 memcpy( psShape->padfZ + i,
-                        psSHP->pabyRec + nOffset + 16 + i*8, 8 );
+                        pabyRec + nOffset + 16 + i*8, 8 );
                 if( bBigEndian ) SwapWord( 8, psShape->padfZ + i );
             }
 
@@ -1520,8 +1912,8 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
         if( psSHP->panRecSize[hEntity]+8 >= nOffset + 16 + 8*nPoints )
         {
-            memcpy( &(psShape->dfMMin), psSHP->pabyRec + nOffset, 8 );
-            memcpy( &(psShape->dfMMax), psSHP->pabyRec + nOffset + 8, 8 );
+            memcpy( &(psShape->dfMMin), pabyRec + nOffset, 8 );
+            memcpy( &(psShape->dfMMax), pabyRec + nOffset + 8, 8 );
             
             if( bBigEndian ) SwapWord( 8, &(psShape->dfMMin) );
             if( bBigEndian ) SwapWord( 8, &(psShape->dfMMax) );
@@ -1529,7 +1921,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
             for( i = 0; i < nPoints; i++ )
             {
                 memcpy( psShape->padfM + i,
-                        psSHP->pabyRec + nOffset + 16 + i*8, 8 );
+                        pabyRec + nOffset + 16 + i*8, 8 );
                 if( bBigEndian ) SwapWord( 8, psShape->padfM + i );
             }
         }
@@ -1550,8 +1942,8 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
         psShape->padfZ = (double *) calloc(1,sizeof(double));
         psShape->padfM = (double *) calloc(1,sizeof(double));
 
-	memcpy( psShape->padfX, psSHP->pabyRec + 12, 8 );
-	memcpy( psShape->padfY, psSHP->pabyRec + 20, 8 );
+	memcpy( psShape->padfX, pabyRec + 12, 8 );
+	memcpy( psShape->padfY, pabyRec + 20, 8 );
 
 	if( bBigEndian ) SwapWord( 8, psShape->padfX );
 	if( bBigEndian ) SwapWord( 8, psShape->padfY );
@@ -1563,7 +1955,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
         if( psShape->nSHPType == SHPT_POINTZ )
         {
-            memcpy( psShape->padfZ, psSHP->pabyRec + nOffset, 8 );
+            memcpy( psShape->padfZ, pabyRec + nOffset, 8 );
         
             if( bBigEndian ) SwapWord( 8, psShape->padfZ );
             
@@ -1578,7 +1970,7 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
 /* -------------------------------------------------------------------- */
         if( psSHP->panRecSize[hEntity]+8 >= nOffset + 8 )
         {
-            memcpy( psShape->padfM, psSHP->pabyRec + nOffset, 8 );
+            memcpy( psShape->padfM, pabyRec + nOffset, 8 );
         
             if( bBigEndian ) SwapWord( 8, psShape->padfM );
         }
@@ -74,6 +74,13 @@ static char rcsid[] =
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
+
 #ifndef TRUE
 #  define TRUE 1
 #  define FALSE 0
@@ -526,6 +533,105 @@ SHPTreeAddShapeId( SHPTree * psTree, SHPObject * psObject )
                                    psTree->nMaxDepth, psTree->nDimension ) );
 }
 
+/************************************************************************/
+/*                        SHPTreeAddShapeBounds()                       */
+/*                                                                      */
+/*      Add a shape id to the tree given only its X/Y extents, as       */
+/*      returned by SHPReadObjectBounds().                              */
+/************************************************************************/
+
+int SHPAPI_CALL
+SHPTreeAddShapeBounds( SHPTree * psTree, int nShapeId,
+                       double * padfBoundsMin, double * padfBoundsMax )
+
+{
+    SHPObject	sObject;
+
+    /* only the id and the X/Y extents are looked at when inserting */
+    memset( &sObject, 0, sizeof(sObject) );
+    sObject.nShapeId = nShapeId;
+    sObject.dfXMin = padfBoundsMin[0];
+    sObject.dfYMin = padfBoundsMin[1];
+    sObject.dfXMax = padfBoundsMax[0];
+    sObject.dfYMax = padfBoundsMax[1];
+
+    return( SHPTreeNodeAddShapeId( psTree->psRoot, &sObject,
+                                   psTree->nMaxDepth, psTree->nDimension ) );
+}
+
+/************************************************************************/
+/*                          SHPTreeNodeMerge()                          */
+/************************************************************************/
+
+static void SHPTreeNodeMerge( SHPTreeNode * psTarget, SHPTreeNode * psSource )
+
+{
+    int		i;
+
+/* -------------------------------------------------------------------- */
+/*      Append the source shape ids to the target node.                 */
+/* -------------------------------------------------------------------- */
+    if( psSource->nShapeCount > 0 )
+    {
+        psTarget->panShapeIds = (int *)
+            SfRealloc( psTarget->panShapeIds, sizeof(int)
+                       * (psTarget->nShapeCount + psSource->nShapeCount) );
+        memcpy( psTarget->panShapeIds + psTarget->nShapeCount,
+                psSource->panShapeIds,
+                sizeof(int) * psSource->nShapeCount );
+        psTarget->nShapeCount += psSource->nShapeCount;
+    }
+
+/* -------------------------------------------------------------------- */
+/*      Subnodes are always created as a full set with bounds that      */
+/*      only depend on the parent, so they line up one to one.  If      */
+/*      only the source has them, just take them over.                  */
+/* -------------------------------------------------------------------- */
+    if( psTarget->nSubNodes == 0 )
+    {
+        psTarget->nSubNodes = psSource->nSubNodes;
+        for( i = 0; i < psSource->nSubNodes; i++ )
+            psTarget->apsSubNode[i] = psSource->apsSubNode[i];
+    }
+    else
+    {
+        assert( psTarget->nSubNodes == psSource->nSubNodes
+                || psSource->nSubNodes == 0 );
+
+        for( i = 0; i < psSource->nSubNodes; i++ )
+        {
+            SHPTreeNodeMerge( psTarget->apsSubNode[i],
+                              psSource->apsSubNode[i] );
+            free( psSource->apsSubNode[i] );
+        }
+    }
+
+    free( psSource->panShapeIds );
+    psSource->panShapeIds = NULL;
+    psSource->nShapeCount = 0;
+    psSource->nSubNodes = 0;
+}
+
+/************************************************************************/
+/*                            SHPTreeMerge()                            */
+/*                                                                      */
+/*      Move every shape id of the source tree into the target and      */
+/*      destroy the source.  Both trees must have been created with     */
+/*      the same root bounds and depth and must not be trimmed yet,     */
+/*      the result is then the same as inserting all shapes into one    */
+/*      tree.  This is what allows building a tree in parallel.         */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPTreeMerge( SHPTree * psTarget, SHPTree * psSource )
+
+{
+    assert( psTarget->nMaxDepth == psSource->nMaxDepth );
+
+    SHPTreeNodeMerge( psTarget->psRoot, psSource->psRoot );
+    SHPDestroyTree( psSource );
+}
+
 /************************************************************************/
 /*                      SHPTreeCollectShapesIds()                       */
 /*                                                                      */
@@ -628,6 +734,56 @@ SHPTreeFindLikelyShapes( SHPTree * hTree,
     return panShapeList;
 }
 
+/************************************************************************/
+/*                        SHPTreeNodeVisit()                            */
+/************************************************************************/
+
+static void
+SHPTreeNodeVisit( SHPTree *hTree, SHPTreeNode * psTreeNode,
+                  double * padfBoundsMin, double * padfBoundsMax,
+                  SHPTreeVisitFunc pfnVisit, void * pUserData )
+
+{
+    int		i;
+
+    if( !SHPCheckBoundsOverlap( psTreeNode->adfBoundsMin,
+                                psTreeNode->adfBoundsMax,
+                                padfBoundsMin,
+                                padfBoundsMax,
+                                hTree->nDimension ) )
+        return;
+
+    if( psTreeNode->nShapeCount > 0 )
+        pfnVisit( psTreeNode->panShapeIds, psTreeNode->nShapeCount,
+                  pUserData );
+
+    for( i = 0; i < psTreeNode->nSubNodes; i++ )
+    {
+        if( psTreeNode->apsSubNode[i] != NULL )
+            SHPTreeNodeVisit( hTree, psTreeNode->apsSubNode[i],
+                              padfBoundsMin, padfBoundsMax,
+                              pfnVisit, pUserData );
+    }
+}
+
+/************************************************************************/
+/*                      SHPTreeVisitLikelyShapes()                      */
+/*                                                                      */
+/*      Same search as SHPTreeFindLikelyShapes(), but nothing is        */
+/*      allocated: the shapeids of each overlapping node are handed     */
+/*      to the callback, unsorted.                                      */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPTreeVisitLikelyShapes( SHPTree * hTree,
+                          double * padfBoundsMin, double * padfBoundsMax,
+                          SHPTreeVisitFunc pfnVisit, void * pUserData )
+
+{
+    SHPTreeNodeVisit( hTree, hTree->psRoot, padfBoundsMin, padfBoundsMax,
+                      pfnVisit, pUserData );
+}
+
 /************************************************************************/
 /*                          SHPTreeNodeTrim()                           */
 /*                                                                      */
@@ -677,3 +833,423 @@ SHPTreeTrimExtraNodes( SHPTree * hTree )
     //SHPTreeNodeTrim( hTree->psRoot );
 }
 
+
+/************************************************************************/
+/*                          SQT file layout.                            */
+/*                                                                      */
+/*      The header is followed by the node array and then the shape     */
+/*      id array, all in native byte order.                             */
+/************************************************************************/
+
+#define SQT_MAGIC	"SQT"
+#define SQT_VERSION	1
+#define SQT_BYTE_ORDER	0x01020304
+#define SQT_MAX_DEPTH	64	/* far deeper than SHPCreateTree() goes */
+
+typedef struct
+{
+    char	achMagic[3];
+    char	nVersion;
+    int		nByteOrder;
+
+    int		nRecords;
+    int		nNodes;
+    int		nShapeIds;
+    int		nReserved;
+
+    double	dfSourceSize;
+    double	dfSourceTime;
+} SQTHeader;
+
+/************************************************************************/
+/*                         SHPTreeNodeCount()                           */
+/*                                                                      */
+/*      Count the nodes and shape ids below (and in) a node.            */
+/************************************************************************/
+
+static void SHPTreeNodeCount( SHPTreeNode * psTreeNode,
+                              int * pnNodes, int * pnShapeIds )
+
+{
+    int		i;
+
+    *pnNodes += 1;
+    *pnShapeIds += psTreeNode->nShapeCount;
+
+    for( i = 0; i < psTreeNode->nSubNodes; i++ )
+        SHPTreeNodeCount( psTreeNode->apsSubNode[i], pnNodes, pnShapeIds );
+}
+
+/************************************************************************/
+/*                         SHPWriteDiskTree()                           */
+/*                                                                      */
+/*      Flatten a tree breadth first and write it out.  The file is     */
+/*      written under a temporary name and renamed into place, so a     */
+/*      concurrent reader never sees a partial file.  The temporary     */
+/*      name is unique to the process and the call, so two writers      */
+/*      of the same tree never interleave in one file.                  */
+/************************************************************************/
+
+static volatile long nTempCounter = 0;
+
+int SHPAPI_CALL
+SHPWriteDiskTree( SHPTree * psTree, const char * pszFilename,
+                  double dfSourceSize, double dfSourceTime )
+
+{
+    SQTHeader		sHeader;
+    SHPTreeNode		**papsQueue;
+    SHPDiskTreeNode	*pasNodes;
+    int			*panShapeIds;
+    int			nNodes = 0, nShapeIds = 0, nQueued, nIdsUsed, i, j;
+    char		*pszTempname;
+    FILE		*fp;
+    int			bOK;
+    long		nTempId;
+    int			nProcessId;
+
+    SHPTreeNodeCount( psTree->psRoot, &nNodes, &nShapeIds );
+
+    papsQueue = (SHPTreeNode **) malloc(sizeof(SHPTreeNode *) * nNodes);
+    pasNodes = (SHPDiskTreeNode *) calloc(nNodes, sizeof(SHPDiskTreeNode));
+    panShapeIds = (int *) malloc(sizeof(int) * (nShapeIds > 0 ? nShapeIds : 1));
+
+/* -------------------------------------------------------------------- */
+/*      Breadth first walk, the queue doubles as the output order.      */
+/* -------------------------------------------------------------------- */
+    papsQueue[0] = psTree->psRoot;
+    nQueued = 1;
+    nIdsUsed = 0;
+
+    for( i = 0; i < nNodes; i++ )
+    {
+        SHPTreeNode	*psTreeNode = papsQueue[i];
+
+        memcpy( pasNodes[i].adfBoundsMin, psTreeNode->adfBoundsMin,
+                sizeof(double) * 2 );
+        memcpy( pasNodes[i].adfBoundsMax, psTreeNode->adfBoundsMax,
+                sizeof(double) * 2 );
+
+        pasNodes[i].nShapeIdStart = nIdsUsed;
+        pasNodes[i].nShapeCount = psTreeNode->nShapeCount;
+        for( j = 0; j < psTreeNode->nShapeCount; j++ )
+            panShapeIds[nIdsUsed++] = psTreeNode->panShapeIds[j];
+
+        pasNodes[i].nSubNodeStart = nQueued;
+        pasNodes[i].nSubNodes = psTreeNode->nSubNodes;
+        for( j = 0; j < psTreeNode->nSubNodes; j++ )
+            papsQueue[nQueued++] = psTreeNode->apsSubNode[j];
+    }
+
+/* -------------------------------------------------------------------- */
+/*      Write header, nodes and ids.                                    */
+/* -------------------------------------------------------------------- */
+    memset( &sHeader, 0, sizeof(sHeader) );
+    memcpy( sHeader.achMagic, SQT_MAGIC, 3 );
+    sHeader.nVersion = SQT_VERSION;
+    sHeader.nByteOrder = SQT_BYTE_ORDER;
+    sHeader.nRecords = psTree->hSHP != NULL ? psTree->hSHP->nRecords : 0;
+    sHeader.nNodes = nNodes;
+    sHeader.nShapeIds = nShapeIds;
+    sHeader.dfSourceSize = dfSourceSize;
+    sHeader.dfSourceTime = dfSourceTime;
+
+#ifdef _WIN32
+    nTempId = InterlockedIncrement( &nTempCounter );
+    nProcessId = _getpid();
+#else
+    nTempId = __sync_add_and_fetch( &nTempCounter, 1 );
+    nProcessId = (int) getpid();
+#endif
+
+    pszTempname = (char *) malloc(strlen(pszFilename) + 40);
+    sprintf( pszTempname, "%s.%d.%ld.tmp", pszFilename, nProcessId, nTempId );
+
+    fp = fopen( pszTempname, "wb" );
+    bOK = fp != NULL;
+    if( bOK )
+    {
+        bOK = fwrite( &sHeader, sizeof(sHeader), 1, fp ) == 1
+            && fwrite( pasNodes, sizeof(SHPDiskTreeNode), nNodes, fp )
+               == (size_t) nNodes
+            && (nShapeIds == 0
+                || fwrite( panShapeIds, sizeof(int), nShapeIds, fp )
+                   == (size_t) nShapeIds);
+        bOK = (fclose( fp ) == 0) && bOK;
+    }
+
+    if( bOK )
+    {
+        remove( pszFilename );
+        bOK = rename( pszTempname, pszFilename ) == 0;
+    }
+
+    if( !bOK )
+        remove( pszTempname );
+
+    free( pszTempname );
+    free( panShapeIds );
+    free( pasNodes );
+    free( papsQueue );
+
+    return bOK;
+}
+
+/************************************************************************/
+/*                          SHPOpenDiskTree()                           */
+/*                                                                      */
+/*      Map a tree written by SHPWriteDiskTree().  Returns NULL if      */
+/*      the file is missing, malformed or stale.                        */
+/************************************************************************/
+
+/* -------------------------------------------------------------------- */
+/*      Check that the nodes are laid out exactly as the writer lays    */
+/*      them out: breadth first, the subnodes and shape ids of each     */
+/*      node following those of the node before.  Subnodes then only    */
+/*      point forward and every node has one parent, so the searches    */
+/*      terminate, and every range and shape id is in bounds.           */
+/* -------------------------------------------------------------------- */
+static int SHPDiskTreeIsValid( const SHPDiskTreeNode * pasNodes, int nNodes,
+                               const int * panShapeIds, int nShapeIds,
+                               int nRecords )
+
+{
+    int		i, nNextSubNode = 1, nNextShapeId = 0;
+    int		nLevelEnd = 1, nDepth = 1;
+
+    for( i = 0; i < nNodes; i++ )
+    {
+        const SHPDiskTreeNode *psNode = pasNodes + i;
+
+        /* a node that no node before it points to */
+        if( i >= nNextSubNode )
+            return FALSE;
+
+        if( i == nLevelEnd )
+        {
+            nLevelEnd = nNextSubNode;
+            if( ++nDepth > SQT_MAX_DEPTH )
+                return FALSE;
+        }
+
+        if( psNode->nShapeIdStart != nNextShapeId
+            || psNode->nShapeCount < 0
+            || psNode->nShapeCount > nShapeIds - nNextShapeId )
+            return FALSE;
+
+        if( psNode->nSubNodeStart != nNextSubNode
+            || psNode->nSubNodes < 0 || psNode->nSubNodes > MAX_SUBNODE
+            || psNode->nSubNodes > nNodes - nNextSubNode )
+            return FALSE;
+
+        nNextShapeId += psNode->nShapeCount;
+        nNextSubNode += psNode->nSubNodes;
+    }
+
+    if( nNextShapeId != nShapeIds || nNextSubNode != nNodes )
+        return FALSE;
+
+    for( i = 0; i < nShapeIds; i++ )
+    {
+        if( panShapeIds[i] < 0 || panShapeIds[i] >= nRecords )
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+SHPDiskTree SHPAPI_CALL1(*)
+SHPOpenDiskTree( const char * pszFilename, int nRecords,
+                 double dfSourceSize, double dfSourceTime )
+
+{
+    FILE		*fp;
+    unsigned char	*pabyData;
+    size_t		nDataSize = 0;
+    SQTHeader		sHeader;
+    SHPDiskTree		*psDiskTree;
+
+    fp = fopen( pszFilename, "rb" );
+    if( fp == NULL )
+        return NULL;
+
+    /* the mapping stays valid after the file is closed */
+    pabyData = SHPMapFile( fp, &nDataSize );
+    fclose( fp );
+
+    if( pabyData == NULL )
+        return NULL;
+
+/* -------------------------------------------------------------------- */
+/*      Validate the header against the source and the file size.       */
+/* -------------------------------------------------------------------- */
+    if( nDataSize < sizeof(sHeader) )
+    {
+        SHPUnmapFile( pabyData, nDataSize );
+        return NULL;
+    }
+
+    memcpy( &sHeader, pabyData, sizeof(sHeader) );
+
+    if( memcmp( sHeader.achMagic, SQT_MAGIC, 3 ) != 0
+        || sHeader.nVersion != SQT_VERSION
+        || sHeader.nByteOrder != SQT_BYTE_ORDER
+        || sHeader.nRecords != nRecords
+        || sHeader.dfSourceSize != dfSourceSize
+        || sHeader.dfSourceTime != dfSourceTime
+        || sHeader.nNodes < 1 || sHeader.nShapeIds < 0
+        || nDataSize != sizeof(sHeader)
+                        + sizeof(SHPDiskTreeNode) * (size_t) sHeader.nNodes
+                        + sizeof(int) * (size_t) sHeader.nShapeIds )
+    {
+        SHPUnmapFile( pabyData, nDataSize );
+        return NULL;
+    }
+
+    if( !SHPDiskTreeIsValid( (const SHPDiskTreeNode *)
+                             (pabyData + sizeof(sHeader)), sHeader.nNodes,
+                             (const int *) (pabyData + sizeof(sHeader)
+                                 + sizeof(SHPDiskTreeNode)
+                                   * (size_t) sHeader.nNodes),
+                             sHeader.nShapeIds, sHeader.nRecords ) )
+    {
+        SHPUnmapFile( pabyData, nDataSize );
+        return NULL;
+    }
+
+    psDiskTree = (SHPDiskTree *) calloc(1, sizeof(SHPDiskTree));
+    psDiskTree->pabyData = pabyData;
+    psDiskTree->nDataSize = nDataSize;
+    psDiskTree->nRecords = sHeader.nRecords;
+    psDiskTree->nNodes = sHeader.nNodes;
+    psDiskTree->pasNodes = (const SHPDiskTreeNode *) (pabyData + sizeof(sHeader));
+    psDiskTree->nShapeIds = sHeader.nShapeIds;
+    psDiskTree->panShapeIds = (const int *)
+        (psDiskTree->pasNodes + sHeader.nNodes);
+
+    return psDiskTree;
+}
+
+/************************************************************************/
+/*                          SHPCloseDiskTree()                          */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPCloseDiskTree( SHPDiskTree * psDiskTree )
+
+{
+    if( psDiskTree == NULL )
+        return;
+
+    SHPUnmapFile( psDiskTree->pabyData, psDiskTree->nDataSize );
+    free( psDiskTree );
+}
+
+/************************************************************************/
+/*                    SHPDiskTreeCollectShapeIds()                      */
+/************************************************************************/
+
+static void
+SHPDiskTreeCollectShapeIds( SHPDiskTree * psDiskTree, int iNode,
+                            double * padfBoundsMin, double * padfBoundsMax,
+                            int * pnShapeCount, int * pnMaxShapes,
+                            int ** ppanShapeList )
+
+{
+    const SHPDiskTreeNode *psNode = psDiskTree->pasNodes + iNode;
+    int		i;
+
+    if( !SHPCheckBoundsOverlap( (double *) psNode->adfBoundsMin,
+                                (double *) psNode->adfBoundsMax,
+                                padfBoundsMin, padfBoundsMax, 2 ) )
+        return;
+
+    if( *pnShapeCount + psNode->nShapeCount > *pnMaxShapes )
+    {
+        *pnMaxShapes = (*pnShapeCount + psNode->nShapeCount) * 2 + 20;
+        *ppanShapeList = (int *)
+            SfRealloc(*ppanShapeList,sizeof(int) * *pnMaxShapes);
+    }
+
+    if( psNode->nShapeCount > 0 )
+    {
+        memcpy( *ppanShapeList + *pnShapeCount,
+                psDiskTree->panShapeIds + psNode->nShapeIdStart,
+                sizeof(int) * psNode->nShapeCount );
+        *pnShapeCount += psNode->nShapeCount;
+    }
+
+    for( i = 0; i < psNode->nSubNodes; i++ )
+        SHPDiskTreeCollectShapeIds( psDiskTree, psNode->nSubNodeStart + i,
+                                    padfBoundsMin, padfBoundsMax,
+                                    pnShapeCount, pnMaxShapes,
+                                    ppanShapeList );
+}
+
+/************************************************************************/
+/*                    SHPDiskTreeFindLikelyShapes()                     */
+/*                                                                      */
+/*      Same contract as SHPTreeFindLikelyShapes(), the result is       */
+/*      sorted and must be freed by the caller.                         */
+/************************************************************************/
+
+int SHPAPI_CALL1(*)
+SHPDiskTreeFindLikelyShapes( SHPDiskTree * psDiskTree,
+                             double * padfBoundsMin, double * padfBoundsMax,
+                             int * pnShapeCount )
+
+{
+    int	*panShapeList=NULL, nMaxShapes = 0;
+
+    *pnShapeCount = 0;
+
+    SHPDiskTreeCollectShapeIds( psDiskTree, 0,
+                                padfBoundsMin, padfBoundsMax,
+                                pnShapeCount, &nMaxShapes,
+                                &panShapeList );
+
+    qsort(panShapeList, *pnShapeCount, sizeof(int), compare_ints);
+
+    return panShapeList;
+}
+
+/************************************************************************/
+/*                    SHPDiskTreeVisitLikelyShapes()                    */
+/*                                                                      */
+/*      Same contract as SHPTreeVisitLikelyShapes(), the shapeids       */
+/*      passed to the callback point into the mapped file.              */
+/************************************************************************/
+
+static void
+SHPDiskTreeNodeVisit( SHPDiskTree * psDiskTree, int iNode,
+                      double * padfBoundsMin, double * padfBoundsMax,
+                      SHPTreeVisitFunc pfnVisit, void * pUserData )
+
+{
+    const SHPDiskTreeNode *psNode = psDiskTree->pasNodes + iNode;
+    int		i;
+
+    if( !SHPCheckBoundsOverlap( (double *) psNode->adfBoundsMin,
+                                (double *) psNode->adfBoundsMax,
+                                padfBoundsMin, padfBoundsMax, 2 ) )
+        return;
+
+    if( psNode->nShapeCount > 0 )
+        pfnVisit( psDiskTree->panShapeIds + psNode->nShapeIdStart,
+                  psNode->nShapeCount, pUserData );
+
+    for( i = 0; i < psNode->nSubNodes; i++ )
+        SHPDiskTreeNodeVisit( psDiskTree, psNode->nSubNodeStart + i,
+                              padfBoundsMin, padfBoundsMax,
+                              pfnVisit, pUserData );
+}
+
+void SHPAPI_CALL
+SHPDiskTreeVisitLikelyShapes( SHPDiskTree * psDiskTree,
+                              double * padfBoundsMin, double * padfBoundsMax,
+                              SHPTreeVisitFunc pfnVisit, void * pUserData )
+
+{
+    SHPDiskTreeNodeVisit( psDiskTree, 0, padfBoundsMin, padfBoundsMax,
+                          pfnVisit, pUserData );
+}